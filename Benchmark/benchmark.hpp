@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+struct BenchOptions
+{
+    uint32_t warmup      = 5;
+    uint32_t repetitions = 50;
+    // Core the measuring thread is pinned to, -1 leaves it to the scheduler
+    int32_t  cpu         = 0;
+};
+
+// All times in milliseconds
+struct BenchStats
+{
+    double min    = 0.0;
+    double median = 0.0;
+    double mean   = 0.0;
+    double stddev = 0.0;
+    double p95    = 0.0;
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t    objects = 0;
+    BenchStats  stats;
+};
+
+
+// Keeps the caches and the frequency of one core instead of migrating between runs
+inline bool pinThread(int32_t cpu)
+{
+    if (cpu < 0) {
+        return true;
+    }
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+inline BenchStats computeStats(std::vector<double> samples)
+{
+    BenchStats stats;
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const uint64_t count = samples.size();
+    double sum = 0.0;
+    for (const double sample : samples) {
+        sum += sample;
+    }
+    stats.mean = sum / count;
+
+    double variance = 0.0;
+    for (const double sample : samples) {
+        variance += (sample - stats.mean) * (sample - stats.mean);
+    }
+    stats.stddev = std::sqrt(variance / count);
+    stats.min    = samples.front();
+    stats.median = count % 2 ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+    stats.p95    = samples[std::min(count - 1, static_cast<uint64_t>(0.95 * count))];
+    return stats;
+}
+
+// setup() runs before every call of kernel() and is not timed, it restores the state the kernel mutates
+template<typename TSetup, typename TKernel>
+BenchStats runBench(const BenchOptions& options, TSetup&& setup, TKernel&& kernel)
+{
+    for (uint32_t i{ 0 }; i < options.warmup; i++) {
+        setup();
+        kernel();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(options.repetitions);
+    for (uint32_t i{ 0 }; i < options.repetitions; i++) {
+        setup();
+        const auto start = std::chrono::steady_clock::now();
+        kernel();
+        samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return computeStats(std::move(samples));
+}
+
+inline void printResults(const std::vector<BenchResult>& results)
+{
+    std::printf("%-28s %10s %10s %10s %10s %10s %10s %12s\n", "benchmark", "objects", "min ms", "median ms", "mean ms", "stddev", "p95 ms", "ns/object");
+    for (const BenchResult& result : results) {
+        const BenchStats& s = result.stats;
+        std::printf("%-28s %10llu %10.4f %10.4f %10.4f %10.4f %10.4f %12.2f\n", result.name.c_str(),
+                    static_cast<unsigned long long>(result.objects), s.min, s.median, s.mean, s.stddev, s.p95,
+                    result.objects ? s.median * 1e6 / result.objects : 0.0);
+    }
+}
+
+// One `name median_ms` line per result, the format of the baseline files.
+// `comment` lines go first, each prefixed with #.
+inline bool writeResults(const std::string& fileName, const std::vector<BenchResult>& results, const std::vector<std::string>& comment = {})
+{
+    std::ofstream file(fileName);
+    if (!file) {
+        return false;
+    }
+    for (const std::string& line : comment) {
+        file << "# " << line << "\n";
+    }
+    for (const BenchResult& result : results) {
+        file << result.name << " " << result.stats.median << "\n";
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <cstdio>
+
+#include "benchmark.hpp"
+
+
+struct GateOptions
+{
+    std::string baseline     = "baseline.txt";
+    // Allowed slowdown of a median, 0.15 for 15%
+    double      tolerance    = 0.15;
+    // Slowdowns smaller than this are timer noise however large they are in percent,
+    // the short phases and kernels would fail the gate on any busy machine otherwise
+    double      min_delta_ms = 0.05;
+};
+
+
+// Reads files written by writeResults(), lines starting with # are comments
+inline bool readBaseline(const std::string& fileName, std::map<std::string, double>& baseline)
+{
+    std::ifstream file(fileName);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        // Names may contain spaces, the value is the last field
+        const uint64_t split = line.find_last_of(' ');
+        if (split == std::string::npos) {
+            continue;
+        }
+        baseline[line.substr(0, split)] = std::strtod(line.c_str() + split + 1, nullptr);
+    }
+    return true;
+}
+
+// Prints one table per group (kernels, then each scene) and returns false if a median regressed past the tolerance
+inline bool checkAgainstBaseline(const std::vector<BenchResult>& results, const std::map<std::string, double>& baseline, const GateOptions& options)
+{
+    bool        passed = true;
+    std::string group;
+    for (const BenchResult& result : results) {
+        const uint64_t    split        = result.name.find_last_of('/');
+        const std::string result_group = result.name.substr(0, split);
+        if (result_group != group) {
+            group = result_group;
+            std::printf("\n%s\n%-24s %12s %12s %9s  %s\n", group.c_str(), "metric", "baseline ms", "current ms", "change", "status");
+        }
+
+        const std::string metric  = result.name.substr(split + 1);
+        const double      current = result.stats.median;
+        const auto        found   = baseline.find(result.name);
+        if (found == baseline.end()) {
+            std::printf("%-24s %12s %12.4f %9s  new\n", metric.c_str(), "-", current, "-");
+            continue;
+        }
+
+        const double reference = found->second;
+        const double change    = reference > 0.0 ? current / reference - 1.0 : 0.0;
+        const bool   ignored   = current - reference < options.min_delta_ms && change > options.tolerance;
+        const bool   regressed = !ignored && change > options.tolerance;
+        const char*  status    = regressed ? "REGRESSED" : ignored ? "noise" : change < -options.tolerance ? "faster" : "ok";
+        std::printf("%-24s %12.4f %12.4f %+8.1f%%  %s\n", metric.c_str(), reference, current, change * 100.0, status);
+        passed &= !regressed;
+    }
+
+    for (const auto& [name, value] : baseline) {
+        bool present = false;
+        for (const BenchResult& result : results) {
+            present |= result.name == name;
+        }
+        if (!present) {
+            std::printf("missing from this run: %s\n", name.c_str());
+        }
+    }
+    return passed;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <cmath>
+
+#include "solver.hpp"
+#include "utils/number_generator.hpp"
+#include "benchmark.hpp"
+
+
+struct KernelOptions
+{
+    uint64_t objects = 10000;
+    // 1 puts neighbours in contact, 0.5 leaves a gap of one radius between them
+    float    density = 1.0f;
+};
+
+
+// Times the solver kernels one at a time on synthetic object sets.
+// Friend of Solver so the private passes can be called without going through update().
+struct SolverBenchmark
+{
+    static constexpr float step_dt = 1.0f / 60.0f / 8.0f;
+
+    // Objects on a jittered square grid, the types cycle through `types` from one slot to the next
+    static Solver makeGrid(uint64_t count, float density, const std::vector<TYPE>& types)
+    {
+        float max_radius = 0.0f;
+        for (const TYPE type : types) {
+            max_radius = std::max(max_radius, materials[type].radius);
+        }
+        const float    spacing = 2.0f * max_radius / std::max(0.05f, density);
+        const uint64_t side    = static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const float    margin  = 4.0f * max_radius;
+
+        Solver solver;
+        solver.setWorldBounds({ 0.0f, 0.0f }, { side * spacing + 2.0f * margin, side * spacing + 2.0f * margin });
+        solver.setChunkSleeping(false);
+        solver.setSubStepsCount(8);
+
+        // One bulk insertion per type, slot k holds type k % types_count
+        const uint64_t types_count = types.size();
+        for (uint64_t t{ 0 }; t < types_count; t++) {
+            const uint64_t type_count = (count - t + types_count - 1) / types_count;
+            solver.addObjects(type_count, types[t], [&](uint64_t i) {
+                const uint64_t slot   = i * types_count + t;
+                const sf::Vector2f jitter = { RNGf::getRange(-0.05f, 0.05f) * spacing, RNGf::getRange(-0.05f, 0.05f) * spacing };
+                return sf::Vector2f{ margin + (slot % side) * spacing, margin + (slot / side) * spacing } + jitter;
+            });
+        }
+        // Puts every object in the simulated list
+        solver.updateChunks();
+        return solver;
+    }
+
+    static std::vector<BenchResult> run(const BenchOptions& bench, const KernelOptions& options)
+    {
+        std::vector<BenchResult> results;
+        const auto add = [&](const char* name, const Solver& initial, auto&& kernel) {
+            Solver solver;
+            const BenchStats stats = runBench(bench, [&] { solver = initial; }, [&] { kernel(solver); });
+            results.push_back({ std::string("kernel/") + name, initial.getObjectsCount(), stats });
+        };
+
+        const Solver sand  = makeGrid(options.objects, options.density, { SAND });
+        const Solver mixed = makeGrid(options.objects, options.density, { SAND, WATER, GAS, DIRT, FIRE_GAS, CONCRETE });
+
+        add("integration", sand, [](Solver& s) { s.updateObjects(step_dt); });
+        add("gravity", mixed, [](Solver& s) { s.applyGravity(); });
+        add("collisions sand", sand, [](Solver& s) { s.checkCollisions(step_dt); });
+        add("collisions mixed", mixed, [](Solver& s) { s.checkCollisions(step_dt); });
+
+        // Horizontal neighbours of the grid, none of these type pairs destroys objects
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        {
+            const uint64_t types_count = 6;
+            const uint64_t side        = static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(options.objects))));
+            // Each type is one contiguous block of m_objects, see makeGrid
+            uint64_t block_start[types_count] = {};
+            for (uint64_t t{ 1 }; t < types_count; t++) {
+                block_start[t] = block_start[t - 1] + (options.objects - (t - 1) + types_count - 1) / types_count;
+            }
+            const auto index_of = [&](uint64_t slot) {
+                return static_cast<uint32_t>(block_start[slot % types_count] + slot / types_count);
+            };
+            for (uint64_t slot{ 0 }; slot + 1 < options.objects; slot++) {
+                if ((slot + 1) % side) {
+                    pairs.emplace_back(index_of(slot), index_of(slot + 1));
+                }
+            }
+        }
+        add("reactions dispatch", mixed, [&](Solver& s) {
+            for (const auto& [a, b] : pairs) {
+                s.computeReaction(s.m_objects[a], s.m_objects[b], 0.5f, 0.5f);
+            }
+        });
+
+        // One rope snaking through the grid positions
+        Solver rope;
+        {
+            const Solver layout = makeGrid(options.objects, options.density, { STRING });
+            std::vector<sf::Vector2f> points;
+            points.reserve(layout.getObjectsCount());
+            for (const VerletObject& obj : layout.getObjects()) {
+                points.push_back(obj.position);
+            }
+            rope.setWorldBounds(layout.m_world_min, layout.m_world_max - layout.m_world_min);
+            rope.setChunkSleeping(false);
+            rope.addChain(points, STRING);
+            rope.updateChunks();
+        }
+        add("links", rope, [](Solver& s) { s.applyLinkConstraint(step_dt); });
+
+        // Spread over twice the world so that about three objects in four get clamped
+        Solver scattered = makeGrid(options.objects, options.density, { SAND });
+        {
+            const sf::Vector2f min  = scattered.m_world_min;
+            const sf::Vector2f size = scattered.m_world_max - scattered.m_world_min;
+            for (VerletObject& obj : scattered.m_objects) {
+                obj.position      = min - 0.5f * size + sf::Vector2f{ RNGf::getUnder(2.0f * size.x), RNGf::getUnder(2.0f * size.y) };
+                obj.position_last = obj.position;
+            }
+        }
+        add("constraint", scattered, [](Solver& s) { s.applyConstraint(step_dt); });
+
+        const sf::Vector2f center = 0.5f * (sand.m_world_min + sand.m_world_max);
+        const float        radius = 0.1f * (sand.m_world_max.x - sand.m_world_min.x);
+        // Brushes query the chunk lists, which the game has built by its first update
+        Solver binned = sand;
+        binned.updateChunks();
+        add("brush delete", binned, [&](Solver& s) { s.deleteBrush(radius, center); });
+        add("brush push", binned, [&](Solver& s) { s.applyPushForce(center, radius); });
+
+        return results;
+    }
+};
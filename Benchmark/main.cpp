@@ -0,0 +1,182 @@
+// Solver benchmarks, without a window.
+//
+//   Benchmark kernels [--objects N] [--density D]
+//   Benchmark scenes  [--scenes-dir DIR] [--frames N]
+//   Benchmark gate    [--baseline FILE] [--tolerance T] [--update]
+//   Benchmark scaling [--counts N,N...] [--threads T,T...] [--thread-objects N] [--frames N] [--sleeping] [--csv FILE]
+//
+// Common options: [--warmup N] [--reps N] [--cpu C] [--out results.txt]
+// gate runs the kernels and the scenes, compares the medians with the baseline file and exits with 1
+// when one is slower than the tolerance allows. --update rewrites the baseline from this run instead,
+// baselines only make sense on the machine that produced them.
+// scaling generates sand, water and lava scenes of growing size, then steps one instance per thread
+// to find how many particles a machine can simulate.
+//
+// On Linux: g++ -std=c++17 -O2 -I../VerletSFML main.cpp -lsfml-graphics -lsfml-system -pthread
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "kernels.hpp"
+#include "scenes.hpp"
+#include "gate.hpp"
+#include "scaling.hpp"
+
+
+// Comma separated list, "1000,10000"
+template<typename T>
+static std::vector<T> parseList(const char* text)
+{
+    std::vector<T> values;
+    char* end = nullptr;
+    for (const char* current = text; *current; current = *end ? end + 1 : end) {
+        const T value = static_cast<T>(std::strtoull(current, &end, 10));
+        if (end == current) {
+            break;
+        }
+        if (value) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+
+static void printUsage()
+{
+    std::cerr << "usage: Benchmark kernels [--objects N] [--density D]\n"
+              << "       Benchmark scenes  [--scenes-dir DIR] [--frames N]\n"
+              << "       Benchmark gate    [--baseline FILE] [--tolerance T] [--update]\n"
+              << "       Benchmark scaling [--counts N,N...] [--threads T,T...] [--thread-objects N] [--frames N] [--sleeping] [--csv FILE]\n"
+              << "common options: [--warmup N] [--reps N] [--cpu C] [--out results.txt]\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+
+    const std::string mode = argv[1];
+    BenchOptions   bench;
+    KernelOptions  kernels;
+    SceneOptions   scenes;
+    GateOptions    gate;
+    ScalingOptions scaling;
+    bool           update_baseline = false;
+    std::string    out;
+    for (int i{ 2 }; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "--objects" && has_value) {
+            kernels.objects = std::max<uint64_t>(2, std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--density" && has_value) {
+            kernels.density = std::strtof(argv[++i], nullptr);
+        }
+        else if (arg == "--scenes-dir" && has_value) {
+            scenes.directory = argv[++i];
+        }
+        else if (arg == "--frames" && has_value) {
+            scenes.frames  = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+            scaling.frames = scenes.frames;
+        }
+        else if (arg == "--counts" && has_value) {
+            scaling.counts = parseList<uint64_t>(argv[++i]);
+        }
+        else if (arg == "--threads" && has_value) {
+            scaling.threads = parseList<uint32_t>(argv[++i]);
+        }
+        else if (arg == "--thread-objects" && has_value) {
+            scaling.thread_objects = std::max<uint64_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--sleeping") {
+            scaling.sleeping = true;
+        }
+        else if (arg == "--csv" && has_value) {
+            scaling.csv = argv[++i];
+        }
+        else if (arg == "--baseline" && has_value) {
+            gate.baseline = argv[++i];
+        }
+        else if (arg == "--tolerance" && has_value) {
+            gate.tolerance = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--update") {
+            update_baseline = true;
+        }
+        else if (arg == "--warmup" && has_value) {
+            bench.warmup = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--reps" && has_value) {
+            bench.repetitions = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (arg == "--cpu" && has_value) {
+            bench.cpu = static_cast<int32_t>(std::strtol(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--out" && has_value) {
+            out = argv[++i];
+        }
+        else {
+            std::cerr << "unknown argument: " << arg << "\n";
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (!pinThread(bench.cpu)) {
+        std::cerr << "cannot pin to cpu " << bench.cpu << ", running unpinned\n";
+    }
+
+    std::vector<BenchResult> results;
+    if (mode == "kernels" || mode == "gate") {
+        results = SolverBenchmark::run(bench, kernels);
+    }
+    if (mode == "scenes" || mode == "gate") {
+        const std::vector<BenchResult> scene_results = runScenes(bench, scenes);
+        results.insert(results.end(), scene_results.begin(), scene_results.end());
+    }
+    if (mode == "scaling") {
+        results = SolverScaling::run(bench, scaling);
+    }
+    if (mode != "kernels" && mode != "scenes" && mode != "gate" && mode != "scaling") {
+        printUsage();
+        return 1;
+    }
+
+    printResults(results);
+    if (!out.empty() && !writeResults(out, results)) {
+        std::cerr << "cannot write " << out << "\n";
+        return 1;
+    }
+
+    if (mode != "gate") {
+        return 0;
+    }
+
+    if (update_baseline) {
+        const std::vector<std::string> comment = {
+            "Median milliseconds, written by `Benchmark gate --update`",
+            "Only comparable with runs on the machine and build configuration that wrote it"
+        };
+        if (!writeResults(gate.baseline, results, comment)) {
+            std::cerr << "cannot write " << gate.baseline << "\n";
+            return 1;
+        }
+        std::cout << "baseline written to " << gate.baseline << "\n";
+        return 0;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!readBaseline(gate.baseline, baseline)) {
+        std::cerr << "cannot read " << gate.baseline << ", run with --update to create it\n";
+        return 1;
+    }
+    const bool passed = checkAgainstBaseline(results, baseline, gate);
+    std::cout << "\n" << (passed ? "PASSED" : "FAILED") << " with a tolerance of " << gate.tolerance * 100.0 << "%\n";
+    return passed ? 0 : 1;
+}
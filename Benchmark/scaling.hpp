@@ -0,0 +1,246 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "solver.hpp"
+#include "benchmark.hpp"
+
+
+struct ScalingOptions
+{
+    std::vector<uint64_t> counts         = { 1000, 10000, 100000, 1000000 };
+    // Objects of every instance in the thread sweep
+    uint64_t              thread_objects = 100000;
+    // Empty sweeps 1, 2, 4... up to the hardware threads
+    std::vector<uint32_t> threads;
+    uint32_t              frames         = 10;
+    uint32_t              sub_steps      = 8;
+    // Settled chunks stop being simulated when on, the worst case is measured by default
+    bool                  sleeping       = false;
+    // Every measured point as `scene,objects,threads,ms_per_frame,speedup` lines
+    std::string           csv;
+};
+
+enum class ScalingScene : uint8_t
+{
+    SandPile,
+    WaterPool,
+    LavaWater,
+    Count
+};
+
+const std::string scalingSceneString[static_cast<uint8_t>(ScalingScene::Count)]{
+    "sand pile",
+    "water pool",
+    "lava water"
+};
+
+
+struct SolverScaling
+{
+    // Hexagonal packing of `count` objects from the floor up.
+    // The sand column is a third of the world wide and collapses into a pile, the pools span the whole floor,
+    // lava fills the left half and water the right half so they react along the middle.
+    static Solver makeScene(ScalingScene scene, uint64_t count, const ScalingOptions& options)
+    {
+        const bool  sand    = scene == ScalingScene::SandPile;
+        const float radius  = sand ? materials[SAND].radius : std::max(materials[WATER].radius, materials[LAVA].radius);
+        const float spacing = 2.0f * radius;
+        const float row     = spacing * 0.866f;
+
+        // Square block for the pile, four times wider than high for the pools
+        const float    aspect  = sand ? 1.0f : 4.0f;
+        const uint64_t columns = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::sqrt(count * aspect))));
+        const uint64_t rows    = (count + columns - 1) / columns;
+        const float    width   = (sand ? 3.0f : 1.0f) * columns * spacing + 2.0f * spacing;
+        const float    height  = rows * row * 1.5f + 4.0f * spacing;
+
+        Solver solver;
+        solver.setWorldBounds({ 0.0f, 0.0f }, { width, height });
+        solver.setChunkSleeping(options.sleeping);
+        solver.setSubStepsCount(options.sub_steps);
+        solver.setSimulationUpdateRate(60);
+
+        const float left = sand ? columns * spacing : spacing;
+        const auto  slot_position = [=](uint64_t slot) {
+            const uint64_t x = slot % columns;
+            const uint64_t y = slot / columns;
+            return sf::Vector2f{ left + x * spacing + (y % 2) * radius, height - radius - y * row };
+        };
+
+        if (scene == ScalingScene::LavaWater) {
+            // Column halves, each type is added in one block
+            const uint64_t lava_columns = columns / 2;
+            const uint64_t lava_count   = lava_columns * rows;
+            const uint64_t water_count  = count - std::min(count, lava_count);
+            solver.addObjects(count - water_count, LAVA, [&](uint64_t i) {
+                return slot_position((i / lava_columns) * columns + i % lava_columns);
+            });
+            const uint64_t water_columns = columns - lava_columns;
+            solver.addObjects(water_count, WATER, [&](uint64_t i) {
+                return slot_position((i / water_columns) * columns + lava_columns + i % water_columns);
+            });
+        }
+        else {
+            solver.addObjects(count, sand ? SAND : WATER, slot_position);
+        }
+        return solver;
+    }
+
+    // Particle count scaling on the calling thread, phases included to show which one stops being linear
+    static std::vector<BenchResult> runCounts(const BenchOptions& bench, const ScalingOptions& options, std::ofstream& csv)
+    {
+        std::vector<BenchResult> results;
+        std::printf("\nframe time versus particle count, %u substeps\n", options.sub_steps);
+        std::printf("%-12s %10s %12s %12s", "scene", "objects", "ms/frame", "ns/object");
+        for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+            std::printf(" %11s", solverPhaseString[p]);
+        }
+        std::printf("\n");
+
+        for (uint8_t s{ 0 }; s < static_cast<uint8_t>(ScalingScene::Count); s++) {
+            const std::string& name = scalingSceneString[s];
+            for (const uint64_t count : options.counts) {
+                Solver solver = makeScene(static_cast<ScalingScene>(s), count, options);
+                for (uint32_t i{ 0 }; i < bench.warmup; i++) {
+                    solver.update(true);
+                }
+
+                std::vector<double> update_ms;
+                std::vector<double> phase_sum(solver_phases_count, 0.0);
+                for (uint32_t i{ 0 }; i < options.frames; i++) {
+                    solver.update(true);
+                    const SolverStats& stats = solver.getStats();
+                    update_ms.push_back(stats.update_ms);
+                    for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+                        phase_sum[p] += stats.phase_ms[p];
+                    }
+                }
+
+                const BenchStats stats = computeStats(std::move(update_ms));
+                std::printf("%-12s %10llu %12.3f %12.1f", name.c_str(), static_cast<unsigned long long>(count),
+                            stats.median, stats.median * 1e6 / count);
+                for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+                    std::printf(" %11.3f", phase_sum[p] / options.frames);
+                }
+                std::printf("\n");
+                std::fflush(stdout);
+
+                results.push_back({ "scaling/" + name + "/" + std::to_string(count), count, stats });
+                if (csv) {
+                    csv << name << "," << count << ",1," << stats.median << ",1\n";
+                }
+            }
+        }
+        return results;
+    }
+
+    // Solver::update() runs on one thread, the sweep steps one independent instance per thread at the same time.
+    // Instances share no state, each one owns its random generator and input.
+    // The speedup is the throughput over the first thread count (1 by default), it stops growing where the box
+    // runs out of cores or memory bandwidth.
+    static std::vector<BenchResult> runThreads(const BenchOptions& bench, const ScalingOptions& options, std::ofstream& csv)
+    {
+        std::vector<uint32_t> thread_counts = options.threads;
+        if (thread_counts.empty()) {
+            const uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+            for (uint32_t t{ 1 }; t < hardware; t *= 2) {
+                thread_counts.push_back(t);
+            }
+            thread_counts.push_back(hardware);
+        }
+
+        std::vector<BenchResult> results;
+        std::printf("\nthroughput versus threads, one instance of %llu objects per thread\n",
+                    static_cast<unsigned long long>(options.thread_objects));
+        std::printf("%-12s %10s %12s %14s %10s %10s\n", "scene", "threads", "ms/frame", "Mobjects/s", "speedup", "efficiency");
+
+        for (uint8_t s{ 0 }; s < static_cast<uint8_t>(ScalingScene::Count); s++) {
+            const std::string& name            = scalingSceneString[s];
+            const Solver       initial         = makeScene(static_cast<ScalingScene>(s), options.thread_objects, options);
+            double             base_throughput = 0.0;
+
+            for (const uint32_t threads_count : thread_counts) {
+                std::vector<Solver> solvers(threads_count, initial);
+                std::vector<double> frame_ms(threads_count, 0.0);
+                std::atomic<uint32_t> ready = 0;
+                std::atomic<bool>     go    = false;
+
+                std::vector<std::thread> threads;
+                threads.reserve(threads_count);
+                for (uint32_t t{ 0 }; t < threads_count; t++) {
+                    threads.emplace_back([&, t] {
+                        if (bench.cpu >= 0) {
+                            pinThread((bench.cpu + t) % std::max(1u, std::thread::hardware_concurrency()));
+                        }
+                        Solver& solver = solvers[t];
+                        for (uint32_t i{ 0 }; i < bench.warmup; i++) {
+                            solver.update(true);
+                        }
+                        // All instances start measuring together so they compete for the whole run
+                        ready.fetch_add(1);
+                        while (!go.load()) {
+                            std::this_thread::yield();
+                        }
+                        const auto start = std::chrono::steady_clock::now();
+                        for (uint32_t i{ 0 }; i < options.frames; i++) {
+                            solver.update(true);
+                        }
+                        frame_ms[t] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+                    });
+                }
+                while (ready.load() < threads_count) {
+                    std::this_thread::yield();
+                }
+                go.store(true);
+                for (std::thread& thread : threads) {
+                    thread.join();
+                }
+
+                // The slowest instance bounds the throughput
+                const BenchStats stats   = computeStats(frame_ms);
+                const double     slowest    = *std::max_element(frame_ms.begin(), frame_ms.end());
+                const double     throughput = threads_count * options.thread_objects / slowest * 1e-3;
+                if (threads_count == thread_counts.front()) {
+                    base_throughput = throughput / threads_count;
+                }
+                const double speedup = throughput / base_throughput;
+                std::printf("%-12s %10u %12.3f %14.2f %10.2f %9.0f%%\n", name.c_str(), threads_count, slowest,
+                            throughput, speedup, speedup * 100.0 / threads_count);
+                std::fflush(stdout);
+
+                results.push_back({ "threads/" + name + "/" + std::to_string(threads_count), options.thread_objects, stats });
+                if (csv) {
+                    csv << name << "," << options.thread_objects << "," << threads_count << "," << slowest << "," << speedup << "\n";
+                }
+            }
+        }
+        return results;
+    }
+
+    static std::vector<BenchResult> run(const BenchOptions& bench, const ScalingOptions& options)
+    {
+        std::ofstream csv;
+        if (!options.csv.empty()) {
+            csv.open(options.csv);
+            if (csv) {
+                csv << "scene,objects,threads,ms_per_frame,speedup\n";
+            }
+            else {
+                std::fprintf(stderr, "cannot write %s\n", options.csv.c_str());
+            }
+        }
+
+        std::vector<BenchResult> results = runCounts(bench, options, csv);
+        const std::vector<BenchResult> thread_results = runThreads(bench, options, csv);
+        results.insert(results.end(), thread_results.begin(), thread_results.end());
+        return results;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <string>
+
+#include "solver.hpp"
+#include "benchmark.hpp"
+
+
+struct SceneOptions
+{
+    // Where the game keeps its saves, relative to the Benchmark project
+    std::string              directory = "../VerletSFML";
+    std::vector<std::string> scenes    = { "save2.txt", "save5.txt", "save8.txt" };
+    uint32_t                 frames    = 300;
+    // Fixed so that the adaptive count does not hide a slower step
+    uint32_t                 sub_steps = 8;
+};
+
+
+// Steps the saved scenes in the game container and reports the frame time and every solver phase.
+// The statistics are over the frames, warmup frames are left out.
+inline std::vector<BenchResult> runScenes(const BenchOptions& bench, const SceneOptions& options)
+{
+    std::vector<BenchResult> results;
+    for (const std::string& scene : options.scenes) {
+        Solver solver;
+        solver.setWorldBounds({ 50.0f, 50.0f }, { 1400.0f, 900.0f });
+        solver.setSimulationUpdateRate(60);
+        solver.setSubStepsCount(options.sub_steps);
+        // Reactions roll random numbers, every run has to see the same sequence
+        solver.setRandomSeed(1);
+        if (!solver.readSave(options.directory + "/" + scene)) {
+            std::fprintf(stderr, "cannot open %s/%s, skipped\n", options.directory.c_str(), scene.c_str());
+            continue;
+        }
+
+        for (uint32_t i{ 0 }; i < bench.warmup; i++) {
+            solver.update(true);
+        }
+
+        std::vector<double> update_ms;
+        std::vector<std::vector<double>> phase_ms(solver_phases_count);
+        update_ms.reserve(options.frames);
+        for (std::vector<double>& samples : phase_ms) {
+            samples.reserve(options.frames);
+        }
+        for (uint32_t i{ 0 }; i < options.frames; i++) {
+            solver.update(true);
+            const SolverStats& stats = solver.getStats();
+            update_ms.push_back(stats.update_ms);
+            for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+                phase_ms[p].push_back(stats.phase_ms[p]);
+            }
+        }
+
+        const std::string name    = scene.substr(0, scene.find_last_of('.'));
+        const uint64_t    objects = solver.getObjectsCount();
+        results.push_back({ "scene/" + name + "/update", objects, computeStats(std::move(update_ms)) });
+        for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+            results.push_back({ "scene/" + name + "/" + solverPhaseString[p], objects, computeStats(std::move(phase_ms[p])) });
+        }
+    }
+    return results;
+}
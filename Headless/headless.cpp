@@ -0,0 +1,289 @@
+// Runs a scene without a window, for soak tests and capacity planning.
+//
+//   Headless <scene.txt> [--frames N] [--substeps N|auto] [--rate HZ] [--pbf] [--sleeping]
+//            [--bounds WIDTH HEIGHT] [--out final.txt] [--stats stats.json|stats.csv] [--trace trace.json]
+//            [--expect-sub-steps MAX]
+//
+// --pbf solves water and lava with the position based fluid density constraint.
+// --sleeping stops simulating settled chunks, the game keeps every chunk simulated.
+// --expect-sub-steps fails the run when the mean adaptive sub step count is above MAX.
+// settled.txt is sand and water at rest, it has to stay cheap:
+//   Headless settled.txt --stats stats.json --expect-sub-steps 2
+//
+// The stats file is a summary when it ends with .json and one row per frame when it ends with .csv.
+// Both include the object churn, heap allocations and solver memory, to spot growth over long runs.
+// On Linux: g++ -std=c++17 -O2 -I../VerletSFML headless.cpp -lsfml-graphics -lsfml-system -pthread
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "solver.hpp"
+#include "utils/alloc_counter_hook.hpp"
+
+
+struct RunConfig
+{
+    std::string  scene;
+    std::string  out;
+    std::string  stats;
+    std::string  trace;
+    uint64_t     frames           = 600;
+    // 0 keeps the adaptive count the game uses
+    uint32_t     sub_steps        = 0;
+    uint32_t     rate             = 60;
+    bool         pbf              = false;
+    bool         sleeping         = false;
+    // 0 when unchecked
+    float        expect_sub_steps = 0.0f;
+    // Same container as the 1500x1000 window of the game
+    sf::Vector2f bounds_min       = { 50.0f, 50.0f };
+    sf::Vector2f bounds_size      = { 1400.0f, 900.0f };
+};
+
+struct FrameSample
+{
+    double   ms;
+    std::array<float, solver_phases_count> phase_ms;
+    uint32_t sub_steps;
+    uint64_t objects;
+    uint64_t active_objects;
+    uint64_t awake_chunks;
+    uint64_t spawned;
+    uint64_t removed;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t memory_bytes;
+};
+
+
+static void printUsage()
+{
+    std::cerr << "usage: Headless <scene.txt> [--frames N] [--substeps N|auto] [--rate HZ] [--pbf] [--sleeping]\n"
+              << "                [--bounds WIDTH HEIGHT] [--out final.txt] [--stats stats.json|stats.csv] [--trace trace.json]\n"
+              << "                [--expect-sub-steps MAX]\n";
+}
+
+static bool endsWith(const std::string& str, const std::string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool parseArgs(int argc, char** argv, RunConfig& config)
+{
+    for (int i{ 1 }; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "--frames" && has_value) {
+            config.frames = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--substeps" && has_value) {
+            const std::string value = argv[++i];
+            config.sub_steps = value == "auto" ? 0 : static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--rate" && has_value) {
+            config.rate = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (arg == "--pbf") {
+            config.pbf = true;
+        }
+        else if (arg == "--sleeping") {
+            config.sleeping = true;
+        }
+        else if (arg == "--bounds" && i + 2 < argc) {
+            config.bounds_size.x = std::strtof(argv[++i], nullptr);
+            config.bounds_size.y = std::strtof(argv[++i], nullptr);
+        }
+        else if (arg == "--out" && has_value) {
+            config.out = argv[++i];
+        }
+        else if (arg == "--stats" && has_value) {
+            config.stats = argv[++i];
+        }
+        else if (arg == "--trace" && has_value) {
+            config.trace = argv[++i];
+        }
+        else if (arg == "--expect-sub-steps" && has_value) {
+            config.expect_sub_steps = std::strtof(argv[++i], nullptr);
+        }
+        else if (arg[0] != '-' && config.scene.empty()) {
+            config.scene = arg;
+        }
+        else {
+            std::cerr << "unknown argument: " << arg << "\n";
+            return false;
+        }
+    }
+    return !config.scene.empty();
+}
+
+static bool writeStatsCsv(const std::string& fileName, const std::vector<FrameSample>& samples)
+{
+    std::ofstream file(fileName);
+    if (!file) {
+        return false;
+    }
+
+    file << "frame,ms,sub_steps,objects,active_objects,awake_chunks,spawned,removed,allocations,allocated_bytes,memory_bytes\n";
+    for (uint64_t i{ 0 }; i < samples.size(); i++) {
+        const FrameSample& s = samples[i];
+        file << i << "," << s.ms << "," << s.sub_steps << "," << s.objects << ","
+             << s.active_objects << "," << s.awake_chunks << "," << s.spawned << "," << s.removed << ","
+             << s.allocations << "," << s.allocated_bytes << "," << s.memory_bytes << "\n";
+    }
+    return true;
+}
+
+static bool writeStatsJson(const std::string& fileName, const RunConfig& config, const std::vector<FrameSample>& samples, double total_ms)
+{
+    std::ofstream file(fileName);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<double> frame_ms;
+    frame_ms.reserve(samples.size());
+    double sub_steps_sum = 0.0;
+    std::array<double, solver_phases_count> phase_ms_sum{};
+    uint64_t spawned     = 0;
+    uint64_t removed     = 0;
+    uint64_t allocations = 0;
+    uint64_t peak_memory = 0;
+    for (const FrameSample& s : samples) {
+        frame_ms.push_back(s.ms);
+        sub_steps_sum += s.sub_steps;
+        spawned       += s.spawned;
+        removed       += s.removed;
+        allocations   += s.allocations;
+        peak_memory    = std::max(peak_memory, s.memory_bytes);
+        for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+            phase_ms_sum[p] += s.phase_ms[p];
+        }
+    }
+    std::sort(frame_ms.begin(), frame_ms.end());
+
+    const uint64_t count = frame_ms.size();
+    const auto percentile = [&](double p) {
+        return count ? frame_ms[std::min(count - 1, static_cast<uint64_t>(p * count))] : 0.0;
+    };
+    const FrameSample last = count ? samples.back() : FrameSample{};
+
+    file << "{\n"
+         << "  \"scene\": \"" << config.scene << "\",\n"
+         << "  \"frames\": " << count << ",\n"
+         << "  \"rate\": " << config.rate << ",\n"
+         << "  \"pbf\": " << (config.pbf ? "true" : "false") << ",\n"
+         << "  \"sleeping\": " << (config.sleeping ? "true" : "false") << ",\n"
+         << "  \"total_ms\": " << total_ms << ",\n"
+         << "  \"mean_ms\": " << (count ? total_ms / count : 0.0) << ",\n"
+         << "  \"p50_ms\": " << percentile(0.5) << ",\n"
+         << "  \"p95_ms\": " << percentile(0.95) << ",\n"
+         << "  \"max_ms\": " << (count ? frame_ms.back() : 0.0) << ",\n"
+         << "  \"mean_sub_steps\": " << (count ? sub_steps_sum / count : 0.0) << ",\n"
+         << "  \"mean_phase_ms\": {";
+    for (uint32_t p{ 0 }; p < solver_phases_count; p++) {
+        file << (p ? ", " : "") << "\"" << solverPhaseString[p] << "\": " << (count ? phase_ms_sum[p] / count : 0.0);
+    }
+    file << "},\n"
+         << "  \"final_objects\": " << last.objects << ",\n"
+         << "  \"final_active_objects\": " << last.active_objects << ",\n"
+         << "  \"spawned\": " << spawned << ",\n"
+         << "  \"removed\": " << removed << ",\n"
+         << "  \"mean_allocations\": " << (count ? static_cast<double>(allocations) / count : 0.0) << ",\n"
+         << "  \"final_memory_bytes\": " << last.memory_bytes << ",\n"
+         << "  \"peak_memory_bytes\": " << peak_memory << "\n"
+         << "}\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    RunConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage();
+        return 1;
+    }
+
+    Tracer::get().setThreadName("Main");
+    if (!config.trace.empty()) {
+        Tracer::get().start();
+    }
+
+    static Solver solver;
+    solver.setWorldBounds(config.bounds_min, config.bounds_size);
+    solver.setSimulationUpdateRate(config.rate);
+    solver.setPositionBasedFluids(config.pbf);
+    solver.setChunkSleeping(config.sleeping);
+    if (config.sub_steps) {
+        solver.setSubStepsCount(config.sub_steps);
+    }
+    else {
+        solver.setAdaptiveSubSteps(1, 8);
+    }
+
+    try {
+        if (!solver.readSave(config.scene)) {
+            std::cerr << "cannot open " << config.scene << "\n";
+            return 1;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "malformed scene " << config.scene << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    std::vector<FrameSample> samples;
+    samples.reserve(config.frames);
+    double total_ms      = 0.0;
+    double sub_steps_sum = 0.0;
+    for (uint64_t i{ 0 }; i < config.frames; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        solver.update(true);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        total_ms += ms;
+
+        const SolverStats& stats = solver.getStats();
+        sub_steps_sum += stats.sub_steps;
+        samples.push_back({ ms, stats.phase_ms, stats.sub_steps, solver.getObjectsCount(), stats.active_objects, stats.awake_chunks,
+                            stats.spawned, stats.removed, stats.allocations, stats.allocated_bytes, solver.getMemory().getTotalBytes() });
+    }
+
+    if (!config.trace.empty()) {
+        Tracer::get().stop();
+        if (!Tracer::get().write(config.trace)) {
+            std::cerr << "cannot write " << config.trace << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << config.frames << " frames in " << total_ms << " ms, "
+              << solver.getObjectsCount() << " objects\n";
+
+    if (!config.out.empty() && !solver.writeSave(config.out)) {
+        std::cerr << "cannot write " << config.out << "\n";
+        return 1;
+    }
+
+    if (!config.stats.empty()) {
+        const bool written = endsWith(config.stats, ".csv") ? writeStatsCsv(config.stats, samples)
+                                                            : writeStatsJson(config.stats, config, samples, total_ms);
+        if (!written) {
+            std::cerr << "cannot write " << config.stats << "\n";
+            return 1;
+        }
+    }
+
+    const double mean_sub_steps = config.frames ? sub_steps_sum / config.frames : 0.0;
+    if (config.expect_sub_steps > 0.0f && mean_sub_steps > config.expect_sub_steps) {
+        std::cerr << "mean sub steps " << mean_sub_steps << " above the expected " << config.expect_sub_steps << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -11,15 +11,24 @@ class Button {
 		std::string text;
 		int fontSize;
 		sf::Color color;
-		sf::Font font;
 		bool lastPressed;
+		// Bumped whenever the look changes, the UI layer rebuilds its geometry then
+		uint32_t version;
+
+		void setColor(sf::Color value);
 	
 	public:
 		Button(sf::Vector2f pos, float _sizeX, float _sizeY, std::string _text, int _fontSize);
 		bool canPress(sf::Vector2f pos);
-		void drawButton(sf::RenderTarget& target) const;
 		void setLastPressed(bool value);
 		bool getLastPressed() const;
+
+		sf::Vector2f getPosition() const;
+		sf::Vector2f getSize() const;
+		const std::string& getText() const;
+		uint32_t getFontSize() const;
+		sf::Color getColor() const;
+		uint32_t getVersion() const;
 };
 
 bool Button::canPress(sf::Vector2f pos) {
@@ -27,23 +36,23 @@ bool Button::canPress(sf::Vector2f pos) {
 	float halfY = sizeY / 2.0f;
 
 	if (pos.x > position.x + halfX) {
-		color = sf::Color::White;
+		setColor(sf::Color::White);
 		return false;
 	}
 	if (pos.x < position.x - halfX) {
-		color = sf::Color::White;
+		setColor(sf::Color::White);
 		return false;
 	}
 	if (pos.y > position.y + halfY) {
-		color = sf::Color::White;
+		setColor(sf::Color::White);
 		return false;
 	}
 	if (pos.y < position.y - halfY) {
-		color = sf::Color::White;
+		setColor(sf::Color::White);
 		return false;
 	}
 
-	color = { 200,200,200 };
+	setColor({ 200,200,200 });
 
 	return true;
 }
@@ -51,34 +60,16 @@ bool Button::canPress(sf::Vector2f pos) {
 Button::Button(sf::Vector2f pos, float _sizeX, float _sizeY, std::string _text, int _fontSize) :
 	position(pos), sizeX(_sizeX), sizeY(_sizeY), text(_text), fontSize(_fontSize) {
 
-	font.loadFromFile("THSarabunNew.ttf");
 	color = sf::Color::White;
 	lastPressed = false;
+	version = 0;
 }
 
-void Button::drawButton(sf::RenderTarget& target) const {
-	sf::RectangleShape button;
-	button.setSize({ sizeX, sizeY });
-	button.setFillColor(color);
-	button.setOrigin({ sizeX / 2.0f , sizeY / 2.0f });
-	button.setPosition(position);
-
-	sf::Text textObj;
-	textObj.setFont(font);
-	textObj.setString(text);
-	textObj.setCharacterSize(fontSize);
-	textObj.setFillColor(sf::Color::Blue);
-	//textObj.setPosition(position);
-	//textObj.setOrigin({0.5f , 0.5f});
-	/*textObj.setPosition(position + sf::Vector2f(sizeX/ 2.0f - textObj.getLocalBounds().width / 2.0f,
-		sizeY / 2.0f - textObj.getLocalBounds().height));*/
-
-	textObj.setPosition(button.getPosition() + sf::Vector2f(button.getSize().x / 2.0f - textObj.getLocalBounds().width,
-		button.getSize().y / 3.0f - 3.0f *  textObj.getLocalBounds().height));
-
-
-	target.draw(button);
-	target.draw(textObj);
+void Button::setColor(sf::Color value) {
+	if (color != value) {
+		color = value;
+		version++;
+	}
 }
 
 void Button::setLastPressed(bool value) {
@@ -87,4 +78,28 @@ void Button::setLastPressed(bool value) {
 
 bool Button::getLastPressed() const {
 	return lastPressed;
+}
+
+sf::Vector2f Button::getPosition() const {
+	return position;
+}
+
+sf::Vector2f Button::getSize() const {
+	return { sizeX, sizeY };
+}
+
+const std::string& Button::getText() const {
+	return text;
+}
+
+uint32_t Button::getFontSize() const {
+	return static_cast<uint32_t>(fontSize);
+}
+
+sf::Color Button::getColor() const {
+	return color;
+}
+
+uint32_t Button::getVersion() const {
+	return version;
 }
\ No newline at end of file
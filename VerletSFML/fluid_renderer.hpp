@@ -0,0 +1,251 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "solver.hpp"
+#include "utils/worker_pool.hpp"
+
+
+// Liquids drawn as a surface instead of one disc per particle.
+// Particles are splatted in a coarse density grid, one layer per liquid, which is thresholded into
+// a texture with one texel per cell. The texture is uploaded once per frame and stretched over the world
+// in a single quad, its filtering smooths the edge of the surface.
+class FluidRenderer
+{
+public:
+    static constexpr uint32_t layers_count                = 2;
+    static constexpr TYPE     layer_types[layers_count]   = { WATER, LAVA };
+
+    // Layer of `type`, layers_count for the types that are not drawn as a surface
+    [[nodiscard]]
+    static uint32_t getLayer(TYPE type)
+    {
+        for (uint32_t layer{ 0 }; layer < layers_count; layer++) {
+            if (layer_types[layer] == type) {
+                return layer;
+            }
+        }
+        return layers_count;
+    }
+
+    // Rebuilds the texture from the objects at `alpha` between the last two updates
+    void update(const Solver& solver, float alpha)
+    {
+        resize(getBounds(solver));
+
+        // The splat only walks the liquids
+        m_particles.clear();
+        for (const VerletObject& obj : solver.getObjects()) {
+            const uint32_t layer = getLayer(obj.type);
+            if (layer < layers_count) {
+                m_particles.push_back({ obj.getInterpolatedPosition(alpha), obj.radius, layer });
+            }
+        }
+
+        const uint32_t bands_count = m_particles.size() >= parallel_min_particles
+                                   ? std::min(WorkerPool::get().getThreadsCount(), m_height)
+                                   : 1;
+        binParticles(bands_count);
+
+        // Every band of rows is splatted and thresholded by one thread, no two threads write the same cell
+        const auto fill_band = [&](uint32_t band) {
+            const uint32_t row_begin  = m_height * band / bands_count;
+            const uint32_t row_end    = m_height * (band + 1) / bands_count;
+            const uint64_t cell_begin = static_cast<uint64_t>(row_begin) * m_width;
+            const uint64_t cell_end   = static_cast<uint64_t>(row_end) * m_width;
+            std::fill(m_density.begin() + cell_begin * layers_count, m_density.begin() + cell_end * layers_count, 0.0f);
+            for (uint32_t i{ m_band_start[band] }; i < m_band_start[band + 1]; i++) {
+                splat(m_particles[m_band_particles[i]], row_begin, row_end);
+            }
+            for (uint64_t cell{ cell_begin }; cell < cell_end; cell++) {
+                writeTexel(cell);
+            }
+        };
+        if (bands_count > 1) {
+            WorkerPool::get().forEachSlice(bands_count, fill_band);
+        }
+        else {
+            fill_band(0);
+        }
+
+        m_texture.update(m_pixels.data());
+    }
+
+    void draw(sf::RenderTarget& target) const
+    {
+        target.draw(m_sprite);
+    }
+
+    // Liquid particles in the last update() call
+    [[nodiscard]]
+    uint64_t getParticlesCount() const
+    {
+        return m_particles.size();
+    }
+
+private:
+    // World units covered by a texel
+    static constexpr float    cell_size            = 3.0f;
+    // Radius of the kernel a particle is splatted with, relative to the particle radius
+    static constexpr float    kernel_scale         = 2.0f;
+    // Density ramp over which the surface fades in, 1 is a packed liquid
+    static constexpr float    surface_low          = 0.25f;
+    static constexpr float    surface_high         = 0.45f;
+    // Below this many liquid particles the splat is not worth spreading over threads
+    static constexpr uint64_t parallel_min_particles = 16384;
+
+    struct Particle
+    {
+        sf::Vector2f position;
+        float        radius;
+        uint32_t     layer;
+    };
+
+    sf::FloatRect         m_bounds;
+    uint32_t              m_width       = 0;
+    uint32_t              m_height      = 0;
+    uint64_t              m_cells_count = 0;
+    std::vector<Particle> m_particles;
+    // Particles overlapping every band of rows, the ones on a border are in both bands
+    std::vector<uint32_t> m_band_start;
+    std::vector<uint32_t> m_band_particles;
+    std::vector<uint32_t> m_band_write;
+    std::vector<uint32_t> m_row_band;
+    std::vector<float>    m_density;
+    std::vector<uint8_t>  m_pixels;
+    sf::Texture           m_texture;
+    sf::Sprite            m_sprite;
+
+    [[nodiscard]]
+    static sf::FloatRect getBounds(const Solver& solver)
+    {
+        if (solver.getConstraintShape() == ConstraintShape::Circle) {
+            const sf::Vector3f constraint = solver.getConstraint();
+            return { constraint.x - constraint.z, constraint.y - constraint.z, 2.0f * constraint.z, 2.0f * constraint.z };
+        }
+        return solver.getWorldBounds();
+    }
+
+    void resize(sf::FloatRect bounds)
+    {
+        const uint32_t width  = std::max(1u, static_cast<uint32_t>(std::ceil(bounds.width / cell_size)));
+        const uint32_t height = std::max(1u, static_cast<uint32_t>(std::ceil(bounds.height / cell_size)));
+        if (width != m_width || height != m_height) {
+            m_width       = width;
+            m_height      = height;
+            m_cells_count = static_cast<uint64_t>(width) * height;
+            m_density.resize(m_cells_count * layers_count);
+            m_pixels.assign(m_cells_count * 4, 0);
+            m_texture.create(width, height);
+            m_texture.setSmooth(true);
+            m_sprite.setTexture(m_texture, true);
+        }
+        m_bounds = bounds;
+        m_sprite.setPosition(bounds.left, bounds.top);
+        m_sprite.setScale(cell_size, cell_size);
+    }
+
+    // Rows covered by the kernel of `particle`, false when it is outside of the grid
+    bool getRows(const Particle& particle, int32_t& y_min, int32_t& y_max) const
+    {
+        const float h       = particle.radius * kernel_scale;
+        const float local_y = particle.position.y - m_bounds.top;
+        y_min = std::max(0, static_cast<int32_t>(std::floor((local_y - h) / cell_size)));
+        y_max = std::min(static_cast<int32_t>(m_height) - 1, static_cast<int32_t>(std::floor((local_y + h) / cell_size)));
+        return y_min <= y_max;
+    }
+
+    // Counting sort of the particles by the bands their kernel overlaps
+    void binParticles(uint32_t bands_count)
+    {
+        m_row_band.resize(m_height);
+        for (uint32_t band{ 0 }; band < bands_count; band++) {
+            std::fill(m_row_band.begin() + m_height * band / bands_count, m_row_band.begin() + m_height * (band + 1) / bands_count, band);
+        }
+
+        m_band_start.assign(bands_count + 1, 0);
+        const auto for_each_band = [&](auto&& callback) {
+            for (uint32_t i{ 0 }; i < m_particles.size(); i++) {
+                int32_t y_min;
+                int32_t y_max;
+                if (getRows(m_particles[i], y_min, y_max)) {
+                    for (uint32_t band{ m_row_band[y_min] }; band <= m_row_band[y_max]; band++) {
+                        callback(band, i);
+                    }
+                }
+            }
+        };
+        for_each_band([this](uint32_t band, uint32_t) { m_band_start[band + 1]++; });
+        for (uint32_t band{ 0 }; band < bands_count; band++) {
+            m_band_start[band + 1] += m_band_start[band];
+        }
+        m_band_particles.resize(m_band_start[bands_count]);
+        m_band_write.assign(m_band_start.begin(), m_band_start.end() - 1);
+        for_each_band([this](uint32_t band, uint32_t i) { m_band_particles[m_band_write[band]++] = i; });
+    }
+
+    // Adds the kernel (1 - d²/h²)² around the particle, scaled so that a hexagonal packing of particles sums to 1.
+    // Only rows in [row_begin, row_end) are written.
+    void splat(const Particle& particle, uint32_t row_begin, uint32_t row_end)
+    {
+        const float        h      = particle.radius * kernel_scale;
+        const float        weight = 6.0f * std::sqrt(3.0f) * particle.radius * particle.radius / (Math::PI * h * h);
+        const sf::Vector2f local  = particle.position - sf::Vector2f{ m_bounds.left, m_bounds.top };
+
+        int32_t y_min;
+        int32_t y_max;
+        getRows(particle, y_min, y_max);
+        y_min = std::max(y_min, static_cast<int32_t>(row_begin));
+        y_max = std::min(y_max, static_cast<int32_t>(row_end) - 1);
+        const int32_t x_min = std::max(0, static_cast<int32_t>(std::floor((local.x - h) / cell_size)));
+        const int32_t x_max = std::min(static_cast<int32_t>(m_width) - 1, static_cast<int32_t>(std::floor((local.x + h) / cell_size)));
+        const float   inv_h2 = 1.0f / (h * h);
+        for (int32_t y{ y_min }; y <= y_max; y++) {
+            const float dy = (y + 0.5f) * cell_size - local.y;
+            for (int32_t x{ x_min }; x <= x_max; x++) {
+                const float dx = (x + 0.5f) * cell_size - local.x;
+                const float q2 = (dx * dx + dy * dy) * inv_h2;
+                if (q2 < 1.0f) {
+                    const float k = 1.0f - q2;
+                    m_density[(static_cast<uint64_t>(y) * m_width + x) * layers_count + particle.layer] += weight * k * k;
+                }
+            }
+        }
+    }
+
+    // Colour mixed from the layers, opacity from the total density
+    void writeTexel(uint64_t cell)
+    {
+        const float* density = &m_density[cell * layers_count];
+        float total = 0.0f;
+        for (uint32_t layer{ 0 }; layer < layers_count; layer++) {
+            total += density[layer];
+        }
+
+        uint8_t* texel = &m_pixels[cell * 4];
+        if (total <= 0.0f) {
+            texel[3] = 0;
+            return;
+        }
+
+        float r = 0.0f;
+        float g = 0.0f;
+        float b = 0.0f;
+        for (uint32_t layer{ 0 }; layer < layers_count; layer++) {
+            const sf::Color color = palette[layer_types[layer]];
+            const float     ratio = density[layer] / total;
+            r += color.r * ratio;
+            g += color.g * ratio;
+            b += color.b * ratio;
+        }
+        const float t     = std::clamp((total - surface_low) / (surface_high - surface_low), 0.0f, 1.0f);
+        const float alpha = t * t * (3.0f - 2.0f * t);
+        // The colour is kept under transparent texels too so that filtering does not darken the edge
+        texel[0] = static_cast<uint8_t>(r);
+        texel[1] = static_cast<uint8_t>(g);
+        texel[2] = static_cast<uint8_t>(b);
+        texel[3] = static_cast<uint8_t>(255.0f * alpha);
+    }
+};
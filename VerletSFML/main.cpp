@@ -11,17 +11,20 @@
 #include "button.hpp"
 #include "solver.hpp"
 #include "renderer.hpp"
+#include "ui.hpp"
 #include "utils/number_generator.hpp"
 #include "utils/math.hpp"
+#include "utils/frame_recorder.hpp"
+#include "utils/trace.hpp"
+// Counts every heap allocation of the game for the performance overlay
+#include "utils/alloc_counter_hook.hpp"
 
 const char g_szClassName[] = "myWindowClass";
 
 std::stringstream ss;
 //sf::Text text[MAXPOINTS];
-// You will use this array to track touch points
-int points[MAXPOINTS][2];
-int last_points[MAXPOINTS][2];
-int diff_points[MAXPOINTS][2];
+// Touch events go through this queue, the solver drains it once per frame
+InputQueue inputQueue;
 // You will use this array to switch the color / track ids
 int idLookup[MAXPOINTS];
 
@@ -57,58 +60,43 @@ BOOL RemoveContactIndex(int index) {
 LRESULT OnTouch(HWND hWnd, WPARAM wParam, LPARAM lParam) {
     BOOL bHandled = FALSE;
     UINT cInputs = LOWORD(wParam);
-    PTOUCHINPUT pInputs = new TOUCHINPUT[cInputs];
+    // Fixed buffer, a touch message never carries more contacts than we track
+    TOUCHINPUT inputs[MAXPOINTS];
+    cInputs = (cInputs > MAXPOINTS ? MAXPOINTS : cInputs);
     POINT ptInput;
-    if (pInputs) {
-        if (GetTouchInputInfo((HTOUCHINPUT)lParam, cInputs, pInputs, sizeof(TOUCHINPUT))) {
-            for (UINT i = 0; i < cInputs; i++) {
-                TOUCHINPUT ti = pInputs[i];
-                int index = GetContactIndex(ti.dwID);
-                if (ti.dwID != 0 && index < MAXPOINTS) {
-                    // Do something with your touch input handle
-                    ptInput.x = TOUCH_COORD_TO_PIXEL(ti.x);
-                    ptInput.y = TOUCH_COORD_TO_PIXEL(ti.y);
-                    ScreenToClient(hWnd, &ptInput);
-
-                    if (ti.dwFlags & TOUCHEVENTF_UP) {
-                        points[index][0] = -1;
-                        points[index][1] = -1;
-                        last_points[index][0] = -1;
-                        last_points[index][1] = -1;
-                        diff_points[index][0] = 0;
-                        diff_points[index][1] = 0;
-
-                        // Remove the old contact index to make it available for the new incremented dwID.
-                        // On some touch devices, the dwID value is continuously incremented.
-                        RemoveContactIndex(index);
-                    }
-                    else {
-                        if (points[index][0] > 0) {
-                            last_points[index][0] = points[index][0];
-                            last_points[index][1] = points[index][1];
-                        }
-                       
-                        points[index][0] = ptInput.x;
-                        points[index][1] = ptInput.y;
-
-                        if (last_points[index][0] > 0) {
-                            diff_points[index][0] = points[index][0] - last_points[index][0];
-                            diff_points[index][1] = points[index][1] - last_points[index][1];
-                        }
-                        
-
-                    }
+    if (GetTouchInputInfo((HTOUCHINPUT)lParam, cInputs, inputs, sizeof(TOUCHINPUT))) {
+        for (UINT i = 0; i < cInputs; i++) {
+            TOUCHINPUT ti = inputs[i];
+            int index = GetContactIndex(ti.dwID);
+            if (ti.dwID != 0 && index >= 0 && index < MAXPOINTS) {
+                // Do something with your touch input handle
+                ptInput.x = TOUCH_COORD_TO_PIXEL(ti.x);
+                ptInput.y = TOUCH_COORD_TO_PIXEL(ti.y);
+                ScreenToClient(hWnd, &ptInput);
+
+                InputEvent event;
+                event.contact = index;
+                event.position = { (float)ptInput.x, (float)ptInput.y };
+
+                if (ti.dwFlags & TOUCHEVENTF_UP) {
+                    event.type = InputEventType::TouchUp;
+
+                    // Remove the old contact index to make it available for the new incremented dwID.
+                    // On some touch devices, the dwID value is continuously incremented.
+                    RemoveContactIndex(index);
+                }
+                else {
+                    event.type = InputEventType::TouchMove;
                 }
+
+                // If the solver fell behind the event is dropped rather than blocking the window thread
+                inputQueue.push(event);
             }
-            bHandled = TRUE;
         }
-        else {
-            /* handle the error here */
-        }
-        delete[] pInputs;
+        bHandled = TRUE;
     }
     else {
-        /* handle the error here, probably out of memory */
+        /* handle the error here */
     }
     if (bHandled) {
         // if you handled the message, close the touch input handle and return
@@ -186,17 +174,11 @@ static VerletObject& InstantiateObject(sf::Vector2f pos, TYPE type) {
 }
 
 static void InstantiateSpawner(sf::Vector2f pos, TYPE type, int delay, float radius) {
-    VerletObject& spawner = solver.addObject(pos, SPAWNER);
-    spawner.spawnerType = type;
-    spawner.counter = delay;
-    spawner.bounce = radius;
+    solver.addSpawner(pos, type, delay, radius, 1.0f);
 }
 
 static void InstantiateSpawner(sf::Vector2f pos, TYPE type, float speed, float radius) {
-    VerletObject& spawner = solver.addObject(pos, SPAWNER);
-    spawner.spawnerType = type;
-    spawner.frictionCoeff = speed;
-    spawner.bounce = radius;
+    solver.addSpawner(pos, type, -1, radius, speed);
 }
 
 static void InstantiateBrush(sf::Vector2f pos, TYPE type, float size) {
@@ -250,19 +232,12 @@ static void endString(Solver& solver, float radius) {
 
     sf::Vector2f finalVecPos = stringPosVec[size - 1] + (normal * (dist + radius));
 
-    uint64_t objIndex = solver.getObjectsCount();
-    VerletObject& firstObj = InstantiateObject(stringPosVec[0], STRING);
-    objIndex++;
-    firstObj.pinned = true;
-    for (uint64_t i = 1; i < stringPosVec.size(); i++) {
-        InstantiateObject(stringPosVec[i], STRING);
-        solver.addLink(objIndex - 1, objIndex);
-
-        objIndex++;
-    }
+    stringPosVec.push_back(finalVecPos);
+    const uint64_t first = solver.addChain(stringPosVec, STRING);
+    objIndex += stringPosVec.size();
 
-    VerletObject& lastObj = InstantiateObject(finalVecPos, STRING);
-    solver.addLink(objIndex - 1, objIndex);
+    solver.m_objects[first].pinned = true;
+    VerletObject& lastObj = solver.m_objects[first + stringPosVec.size() - 1];
     lastObj.radius = radius;
     lastObj.mass = radius * 6.0f;
 
@@ -317,12 +292,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
     // the following code initializes the points
     for (int i = 0; i < MAXPOINTS; i++) {
-        points[i][0] = -1;
-        points[i][1] = -1;
-        last_points[i][0] = -1;
-        last_points[i][1] = -1;
-        diff_points[i][0] = 0;
-        diff_points[i][1] = 0;
         idLookup[i] = -1;
     }
 
@@ -354,9 +323,21 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     const uint32_t frame_rate = 60;
     window.setFramerateLimit(frame_rate);
 
-    // setup font
-    sf::Font font;
-    if (!font.loadFromFile("THSarabunNew.ttf")) {/* error...*/ }
+    // The simulation steps at its own fixed rate, frames in between draw interpolated positions
+    const uint32_t simulation_rate       = 60;
+    const float    simulation_dt         = 1.0f / static_cast<float>(simulation_rate);
+    // Past this the simulation slows down instead of falling further behind
+    const uint32_t max_updates_per_frame = 3;
+    float          simulationAccumulator = 0.0f;
+    sf::Clock      simulationClock;
+
+    // Forces held this frame, pushed into every simulation update instead of once per displayed frame
+    bool                      mouseForce       = false;
+    bool                      centripetalForce = false;
+    std::vector<sf::Vector2f> touchForces;
+
+    // setup font, shared by the whole UI
+    const sf::Font& font = FontCache::get("THSarabunNew.ttf");
     //sf::Text text;
     //text.setFont(font); // font is a sf::Font
     //text.setString("ball");
@@ -364,35 +345,30 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     //text.setFillColor(sf::Color::White);
     //text.setPosition(480, 500);
 
-    sf::Text typeText;
-    typeText.setFont(font);
-    typeText.setCharacterSize(50);
-    typeText.setFillColor(sf::Color::White);
-    typeText.setPosition(60, 30);
-
-    sf::Text speedText;
-    speedText.setFont(font);
-    speedText.setCharacterSize(50);
-    speedText.setFillColor(sf::Color::White);
-    speedText.setPosition(60, 80);
-
-    sf::Text spreadText;
-    spreadText.setFont(font);
-    spreadText.setCharacterSize(50);
-    spreadText.setFillColor(sf::Color::White);
-    spreadText.setPosition(60, 130);
-
-    sf::Text modeText;
-    modeText.setFont(font);
-    modeText.setCharacterSize(50);
-    modeText.setFillColor(sf::Color::White);
-    modeText.setPosition(60, 180);
-
-    sf::Text toggleSimText;
-    toggleSimText.setFont(font);
-    toggleSimText.setCharacterSize(50);
-    toggleSimText.setFillColor(sf::Color::White);
-    toggleSimText.setPosition(60, 230);
+    // HUD labels, their geometry is only rebuilt when a text changes
+    UiLayer ui(font);
+    const sf::Vector2f typeTextPos = { 60, 30 };
+    const sf::Vector2f speedTextPos = { 60, 80 };
+    const sf::Vector2f spreadTextPos = { 60, 130 };
+    const sf::Vector2f modeTextPos = { 60, 180 };
+    const sf::Vector2f toggleSimTextPos = { 60, 230 };
+    const uint32_t typeText = ui.addLabel(typeTextPos, 50, sf::Color::White);
+    const uint32_t speedText = ui.addLabel(speedTextPos, 50, sf::Color::White);
+    const uint32_t spreadText = ui.addLabel(spreadTextPos, 50, sf::Color::White);
+    const uint32_t modeText = ui.addLabel(modeTextPos, 50, sf::Color::White);
+    const uint32_t toggleSimText = ui.addLabel(toggleSimTextPos, 50, sf::Color::White);
+
+    // Performance overlay, refreshed a few times per second since formatting the text is not free
+    const uint32_t perfText = ui.addLabel({ static_cast<float>(window_width) - 330.0f, 30.0f }, 20, sf::Color::White);
+    ui.setVisible(perfText, false);
+    const uint32_t perf_refresh_frames = 15;
+    bool showPerf = false;
+    uint32_t perfFrames = 0;
+    float perfFrameMs = 0.0f;
+    float perfWorkMs = 0.0f;
+    AllocCounter::Snapshot perfAllocations = AllocCounter::get();
+    sf::Clock frameClock;
+    sf::Clock workClock;
 
 
     //for (int i = 0; i < MAXPOINTS; i++) {
@@ -417,11 +393,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
     //Solver   solver;
     Renderer renderer{window};
+    FrameRecorder recorder;
 
     // Solver configuration, boundary constrain
-    solver.setConstraint({static_cast<float>(window_width) * 0.5f, static_cast<float>(window_height) * 0.5f}, 450.0f);
-    solver.setSubStepsCount(4);
-    solver.setSimulationUpdateRate(frame_rate);
+    solver.setWorldBounds({50.0f, 50.0f}, {static_cast<float>(window_width) - 100.0f, static_cast<float>(window_height) - 100.0f});
+    //solver.setConstraint({static_cast<float>(window_width) * 0.5f, static_cast<float>(window_height) * 0.5f}, 450.0f);
+    solver.setAdaptiveSubSteps(1, 8);
+    solver.setSimulationUpdateRate(simulation_rate);
 
     // Set simulation attributes
     const float        object_spawn_delay    = 0.02f;
@@ -453,27 +431,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     //Link& link1 = solver.addLink(objIndex - 1, objIndex);
     //objIndex++;
 
-    /*sf::Vector2f startRopePos = { 500,500 };
-    int startIndex = objIndex;
-    for (int i = 0; i < 10; i++) {
-        for (int j = 0; j < 10; j++) {
-            solver.addObject(startRopePos + sf::Vector2f(i * 10, j * 10), 5, false);
-
-            if (j > 0) {
-                Link& link = solver.addLink(objIndex, objIndex - 1);
-            }
-
-            if (i > 0 && objIndex - 10 > startIndex) {
-                Link& link = solver.addLink(objIndex - 10, objIndex);
-            }
-
-            objIndex++;
-        }
-    }
-
-    objIndex++;*/
+    //solver.addCloth({ 500, 500 }, 10, 10, 10.0f, STRING);
 
-    srand(time(NULL));
+    solver.setRandomSeed(static_cast<uint32_t>(time(NULL)));
 
     sf::Clock clock;
     unsigned int frameNum = 0;
@@ -501,31 +461,47 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     bool isVDown = false;
     bool toggleSimulation = true;
 
+    // Values the HUD labels were last formatted from
+    bool hudDirty = true;
+    TYPE hudType = selectedType;
+    float hudSpeed = speed;
+    float hudSpread = brushSize;
+    bool hudRunning = toggleSimulation;
+    bool hudRecording = false;
+    uint64_t hudDropped = 0;
+    bool hudTracing = false;
+
     bool isODown = false;
     bool isLDown = false;
+    bool isF9Down = false;
+    bool isF3Down = false;
+    bool isF4Down = false;
+    bool isF6Down = false;
+    bool isF10Down = false;
+    Tracer::get().setThreadName("Main");
 
     //bool isCDown = false;
     //bool stringMode = false;
     
-    Button scrollLeftBtnType({ typeText.getPosition().x + typeText.getLocalBounds().width + 360, typeText.getPosition().y + 50 }, 75, 50, "<<<<", 50);
-    Button scrollRightBtnType({ typeText.getPosition().x + typeText.getLocalBounds().width + 460, typeText.getPosition().y + 50 }, 75, 50, ">>>>", 50);
+    Button scrollLeftBtnType({ typeTextPos.x + 360, typeTextPos.y + 50 }, 75, 50, "<<<<", 50);
+    Button scrollRightBtnType({ typeTextPos.x + 460, typeTextPos.y + 50 }, 75, 50, ">>>>", 50);
 
-    Button scrollLeftBtnSpeed({ speedText.getPosition().x + speedText.getLocalBounds().width + 360, speedText.getPosition().y + 50 }, 75, 50, "<<<<", 50);
-    Button scrollRightBtnSpeed({ speedText.getPosition().x + speedText.getLocalBounds().width + 460, speedText.getPosition().y + 50 }, 75, 50, ">>>>", 50);
+    Button scrollLeftBtnSpeed({ speedTextPos.x + 360, speedTextPos.y + 50 }, 75, 50, "<<<<", 50);
+    Button scrollRightBtnSpeed({ speedTextPos.x + 460, speedTextPos.y + 50 }, 75, 50, ">>>>", 50);
 
-    Button scrollLeftBtnSpread({ spreadText.getPosition().x + spreadText.getLocalBounds().width + 360, spreadText.getPosition().y + 50 }, 75, 50, "<<<<", 50);
-    Button scrollRightBtnSpread({ spreadText.getPosition().x + spreadText.getLocalBounds().width + 460, spreadText.getPosition().y + 50 }, 75, 50, ">>>>", 50);
+    Button scrollLeftBtnSpread({ spreadTextPos.x + 360, spreadTextPos.y + 50 }, 75, 50, "<<<<", 50);
+    Button scrollRightBtnSpread({ spreadTextPos.x + 460, spreadTextPos.y + 50 }, 75, 50, ">>>>", 50);
 
-    Button scrollLeftBtnMode({ modeText.getPosition().x + modeText.getLocalBounds().width + 360, modeText.getPosition().y + 50 }, 75, 50, "<<<<", 50);
-    Button scrollRightBtnMode({ modeText.getPosition().x + modeText.getLocalBounds().width + 460, modeText.getPosition().y + 50 }, 75, 50, ">>>>", 50);
+    Button scrollLeftBtnMode({ modeTextPos.x + 360, modeTextPos.y + 50 }, 75, 50, "<<<<", 50);
+    Button scrollRightBtnMode({ modeTextPos.x + 460, modeTextPos.y + 50 }, 75, 50, ">>>>", 50);
 
-    Button scrollLeftBtnToggleSim({ toggleSimText.getPosition().x + toggleSimText.getLocalBounds().width + 360, toggleSimText.getPosition().y + 50 }, 75, 50, "<<<<", 50);
-    Button scrollRightBtnToggleSim({ toggleSimText.getPosition().x + toggleSimText.getLocalBounds().width + 460, toggleSimText.getPosition().y + 50 }, 75, 50, ">>>>", 50);
+    Button scrollLeftBtnToggleSim({ toggleSimTextPos.x + 360, toggleSimTextPos.y + 50 }, 75, 50, "<<<<", 50);
+    Button scrollRightBtnToggleSim({ toggleSimTextPos.x + 460, toggleSimTextPos.y + 50 }, 75, 50, ">>>>", 50);
 
-    Button loadBtn({110, toggleSimText.getPosition().y + 100 }, 75, 50, "LOAD", 50);
-    Button saveBtn({210, toggleSimText.getPosition().y + 100 }, 75, 50, "SAVE", 50);
+    Button loadBtn({110, toggleSimTextPos.y + 100 }, 75, 50, "LOAD", 50);
+    Button saveBtn({210, toggleSimTextPos.y + 100 }, 75, 50, "SAVE", 50);
 
-    Button resetBtn({ 310, toggleSimText.getPosition().y + 100 }, 75, 50, "RESET", 50);
+    Button resetBtn({ 310, toggleSimTextPos.y + 100 }, 75, 50, "RESET", 50);
 
     Button buttonArr[][2] = { {scrollLeftBtnType,scrollRightBtnType},
                               {scrollLeftBtnSpeed,scrollRightBtnSpeed},
@@ -535,6 +511,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                               {loadBtn, saveBtn},
                               {resetBtn,resetBtn}
                             };
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 2; j++) {
+            ui.addButton(buttonArr[i][j]);
+        }
+    }
 
     bool buttonPressArr[][2] = {{false,false},
                                {false,false},
@@ -554,8 +535,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
             DispatchMessage(&Msg);
         }
         else {
+            TraceScope traceInput{ "Input" };
 
-            frameNum++;
+            // Held brushes repeat on simulation updates like the spawners, not on displayed frames
+            const unsigned int inputFrameNum = solver.getFrameNum();
+            const bool holdLagElapsed = inputFrameNum / holdLagFrame != frameNum / holdLagFrame;
+            frameNum = inputFrameNum;
             //if (solver.getObjectsCount() < max_objects_count && clock.getElapsedTime().asSeconds() >= object_spawn_delay) {
             //    clock.restart();
             //    for (int i = 0; i < 5; i++) {
@@ -570,7 +555,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
             //    if (colorIndex >= 1.0f) colorIndex = 0.0f;
             //}
             solver.updateMousePos(sf::Mouse::getPosition(window));
-            solver.updateFrameNum(frameNum);
+            solver.processInput(inputQueue);
+            mouseForce       = false;
+            centripetalForce = false;
+            touchForces.clear();
 
             for (int i = 0; i < 7; i++) {
                 for (int j = 0; j < 2; j++) {
@@ -591,7 +579,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                     }
                 }*/
                 else if (selectedType == NONE) {
-                    solver.applyMouseForce();
+                    mouseForce = true;
                 }
                 else if (selectedType == BLACKHOLE) {
                     if (!isLeftClick) {
@@ -600,7 +588,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                         InstantiateSpawner(mousePosF, selectedType, speed, brushSize);
                     }
                 }
-                else if (frameNum % holdLagFrame == 0 || !isLeftClick) {
+                else if (holdLagElapsed || !isLeftClick) {
                     sf::Vector2i mousePosInt = solver.getCurrentMousePos();
                     sf::Vector2f mousePosF = { (float)mousePosInt.x, (float)mousePosInt.y };
                     //InstantiateObject(mousePosF, selectedType);
@@ -622,9 +610,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                     solver.deleteBrush(brushSize);
                 }
                 else if (selectedType == NONE) {
-                    sf::Vector2i mousePosInt = solver.getCurrentMousePos();
-                    sf::Vector2f mousePosF = { (float)mousePosInt.x, (float)mousePosInt.y };
-                    solver.applyCentripetalForce(mousePosF, brushSize, speed);
+                    centripetalForce = true;
                     //solver.applyMouseForce();
                 }
                 else if (selectedType == BLACKHOLE) {
@@ -634,7 +620,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                         InstantiateSpawner(mousePosF, selectedType, speed, brushSize);
                     }
                 }
-                else if (frameNum % holdLagFrame == 0 || !isRightClick) {
+                else if (holdLagElapsed || !isRightClick) {
                     sf::Vector2i mousePosInt = solver.getCurrentMousePos();
                     sf::Vector2f mousePosF = { (float)mousePosInt.x, (float)mousePosInt.y };
                     //InstantiateObject(mousePosF, selectedType);
@@ -962,19 +948,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
             }
 
             for (int n = 0; n < MAXPOINTS; n++) {
-                if (points[n][0] >= 0 && points[n][1] >= 0) {
-                    sf::Vector2f touchPoint = { (float)points[n][0], (float)points[n][1] };
+                sf::Vector2f touchPoint;
+                if (solver.getTouchContact(n, touchPoint)) {
                     if (isDeleteMode) {
                         solver.deleteBrush(brushSize, touchPoint);
                     }
                     else if (selectedType == NONE) {
-                        solver.applyForce(touchPoint);
+                        touchForces.push_back(touchPoint);
                         //solver.applyCentripetalForce(touchPoint, brushSize);
                     }
                     else if (selectedType == BLACKHOLE) {
                         InstantiateSpawner(touchPoint, selectedType, speed, brushSize);
                     }
-                    else if (frameNum % holdLagFrame == 0) {
+                    else if (holdLagElapsed) {
                         InstantiateObject(touchPoint, selectedType);
                     }
 
@@ -1177,6 +1163,71 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                 isLDown = false;
             }
 
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::F3)) {
+                if (!isF3Down) {
+                    showPerf = !showPerf;
+                    ui.setVisible(perfText, showPerf);
+                }
+                isF3Down = true;
+            }
+            else {
+                isF3Down = false;
+            }
+
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::F4)) {
+                if (!isF4Down) {
+                    renderer.setFluidMode(!renderer.getFluidMode());
+                }
+                isF4Down = true;
+            }
+            else {
+                isF4Down = false;
+            }
+
+            // Water and lava hold their volume through a density constraint
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::F6)) {
+                if (!isF6Down) {
+                    solver.setPositionBasedFluids(!solver.getPositionBasedFluids());
+                }
+                isF6Down = true;
+            }
+            else {
+                isF6Down = false;
+            }
+
+            // Writes a timeline of the frames to trace.json, open it in chrome://tracing or ui.perfetto.dev
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::F10)) {
+                if (!isF10Down) {
+                    if (Tracer::get().isEnabled()) {
+                        Tracer::get().stop();
+                        Tracer::get().write("trace.json");
+                    }
+                    else {
+                        Tracer::get().start();
+                    }
+                }
+                isF10Down = true;
+            }
+            else {
+                isF10Down = false;
+            }
+
+            // Records the frames as PNGs in capture/
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::F9)) {
+                if (!isF9Down) {
+                    if (recorder.isRecording()) {
+                        recorder.stop();
+                    }
+                    else {
+                        recorder.start("capture", window.getSize().x, window.getSize().y);
+                    }
+                }
+                isF9Down = true;
+            }
+            else {
+                isF9Down = false;
+            }
+
             /*if (sf::Keyboard::isKeyPressed(sf::Keyboard::C)) {
                 if (!isCDown) {
                     stringMode = !stringMode;
@@ -1188,10 +1239,41 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                 isCDown = false;
             }*/
 
-            solver.update(toggleSimulation);
+            traceInput.end();
 
+            workClock.restart();
+            float renderAlpha = 1.0f;
+            if (toggleSimulation) {
+                simulationAccumulator += simulationClock.restart().asSeconds();
+                uint32_t updates = 0;
+                while (simulationAccumulator >= simulation_dt && updates < max_updates_per_frame) {
+                    if (mouseForce) {
+                        solver.applyMouseForce();
+                    }
+                    if (centripetalForce) {
+                        solver.applyCentripetalForce(solver.getCurrentMousePosF(), brushSize, speed);
+                    }
+                    for (const sf::Vector2f& touchPoint : touchForces) {
+                        solver.applyForce(touchPoint);
+                    }
+                    solver.update(true);
+                    simulationAccumulator -= simulation_dt;
+                    updates++;
+                }
+                simulationAccumulator = std::min(simulationAccumulator, simulation_dt);
+                renderAlpha = simulationAccumulator / simulation_dt;
+            }
+            else {
+                simulationClock.restart();
+                simulationAccumulator = 0.0f;
+                solver.update(false);
+            }
+
+            TraceScope traceRender{ "Render" };
             window.clear(sf::Color::White);
-            renderer.render(solver);
+            renderer.render(solver, renderAlpha);
+            traceRender.end();
+            TraceScope traceHud{ "HUD" };
                 
                 /*for (int i = 0; i < MAXPOINTS; i++) {
                     if (points[i][0] >= 0) {
@@ -1201,53 +1283,125 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
                 }*/
 
-            std::ostringstream ss;
-            ss << "Type: " << typeString[selectedType];
-            typeText.setString(ss.str());
-
-            std::ostringstream ss2;
-            ss2 << "Speed: " << speed;
-            speedText.setString(ss2.str());
-
-            std::ostringstream ss3;
-            ss3 << "Spread: " << brushSize;
-            spreadText.setString(ss3.str());
+            // The strings are only formatted again when what they show changes
+            if (hudDirty || selectedType != hudType) {
+                hudType = selectedType;
+                ui.setText(typeText, "Type: " + typeString[selectedType]);
+            }
 
-            std::ostringstream ss4;
-            ss4 << "Mode: ";
-            if (isDeleteMode) {
-                ss4 << "Delete";
+            if (hudDirty || speed != hudSpeed) {
+                hudSpeed = speed;
+                std::ostringstream ss2;
+                ss2 << "Speed: " << speed;
+                ui.setText(speedText, ss2.str());
             }
-            /*else if (stringMode) {
-                ss4 << "String";
-            }*/
-            else {
-                ss4 << "Spawn";
+
+            if (hudDirty || brushSize != hudSpread) {
+                hudSpread = brushSize;
+                std::ostringstream ss3;
+                ss3 << "Spread: " << brushSize;
+                ui.setText(spreadText, ss3.str());
             }
-            modeText.setString(ss4.str());
 
-            std::ostringstream ss5;
-            ss5 << "Simulation: ";
-            if (toggleSimulation) {
-                ss5 << "Running";
+            // Literals, setText() skips them when unchanged
+            /*if (stringMode) {
+                ui.setText(modeText, "Mode: String");
+            }*/
+            ui.setText(modeText, isDeleteMode ? "Mode: Delete" : "Mode: Spawn");
+
+            const bool recording = recorder.isRecording();
+            const uint64_t dropped = recording ? recorder.getDroppedCount() : 0;
+            const bool tracing = Tracer::get().isEnabled();
+            if (hudDirty || toggleSimulation != hudRunning || recording != hudRecording || dropped != hudDropped || tracing != hudTracing) {
+                hudRunning = toggleSimulation;
+                hudRecording = recording;
+                hudDropped = dropped;
+                hudTracing = tracing;
+                std::ostringstream ss5;
+                ss5 << "Simulation: ";
+                if (toggleSimulation) {
+                    ss5 << "Running";
+                }
+                else {
+                    ss5 << "Paused";
+                }
+                if (recording) {
+                    ss5 << " (Recording, " << dropped << " dropped)";
+                }
+                if (tracing) {
+                    ss5 << " (Tracing)";
+                }
+                ui.setText(toggleSimText, ss5.str());
             }
-            else {
-                ss5 << "Paused";
+            hudDirty = false;
+
+            perfFrameMs += frameClock.restart().asSeconds() * 1000.0f;
+            perfWorkMs += workClock.getElapsedTime().asSeconds() * 1000.0f;
+            if (++perfFrames == perf_refresh_frames) {
+                const float frameMs = perfFrameMs / perf_refresh_frames;
+                const float workMs = perfWorkMs / perf_refresh_frames;
+                const AllocCounter::Snapshot frameAllocations = AllocCounter::since(perfAllocations);
+                perfAllocations = AllocCounter::get();
+                perfFrames = 0;
+                perfFrameMs = 0.0f;
+                perfWorkMs = 0.0f;
+
+                if (showPerf) {
+                    const SolverStats& stats = solver.getStats();
+                    std::ostringstream ssPerf;
+                    ssPerf.setf(std::ios::fixed);
+                    ssPerf.precision(2);
+                    ssPerf << "FPS: " << (frameMs > 0.0f ? 1000.0f / frameMs : 0.0f) << "\n";
+                    ssPerf << "Frame: " << frameMs << " ms\n";
+                    ssPerf << "Work: " << workMs << " ms\n";
+                    ssPerf << "Update: " << stats.update_ms << " ms\n";
+                    for (uint32_t i = 0; i < solver_phases_count; i++) {
+                        ssPerf << "  " << solverPhaseString[i] << ": " << stats.phase_ms[i] << " ms\n";
+                    }
+                    ssPerf << "Sub steps: " << stats.sub_steps << "\n";
+                    ssPerf << "Objects: " << solver.getObjectsCount() << " (" << stats.active_objects << " active)\n";
+                    for (uint32_t i = 0; i < NUM_OF_TYPE; i++) {
+                        if (stats.type_counts[i]) {
+                            ssPerf << "  " << typeString[i] << ": " << stats.type_counts[i] << "\n";
+                        }
+                    }
+                    ssPerf << "Links: " << stats.links << "\n";
+                    ssPerf << "Pairs: " << stats.collision_pairs << "\n";
+                    ssPerf << "Churn: +" << stats.spawned << " -" << stats.removed << " objects\n";
+
+                    const SolverMemory memory = solver.getMemory();
+                    const auto toMB = [](uint64_t bytes) { return bytes / (1024.0f * 1024.0f); };
+                    ssPerf << "Memory: " << toMB(memory.getTotalBytes()) << " MB\n";
+                    ssPerf << "  Objects: " << memory.objects << "/" << memory.objects_capacity << " " << toMB(memory.object_bytes) << " MB\n";
+                    ssPerf << "  Links: " << memory.links << "/" << memory.links_capacity << " " << toMB(memory.link_bytes) << " MB\n";
+                    ssPerf << "  Index: " << toMB(memory.index_bytes) << " MB\n";
+                    ssPerf << "Heap: " << frameAllocations.allocations / perf_refresh_frames << " allocs/frame, "
+                           << frameAllocations.allocated_bytes / perf_refresh_frames / 1024.0f << " KB/frame\n";
+                    ssPerf << "  Update: " << stats.allocations << " allocs\n";
+
+                    const RenderStats& renderStats = renderer.getStats();
+                    ssPerf << "Render: " << renderStats.vertices << " vertices, " << renderStats.draw_calls << " draws\n";
+                    for (uint32_t i = 0; i < render_lods_count; i++) {
+                        if (renderStats.discs[i]) {
+                            ssPerf << "  " << renderLodString[i] << ": " << renderStats.discs[i] << "\n";
+                        }
+                    }
+                    if (renderer.getFluidMode()) {
+                        ssPerf << "  Fluid: " << renderStats.fluid << "\n";
+                    }
+                    ui.setText(perfText, ssPerf.str());
+                    // Red once the work of a frame no longer fits in the frame rate
+                    ui.setColor(perfText, workMs > 1000.0f / frame_rate ? sf::Color::Red : sf::Color::White);
+                }
             }
-            toggleSimText.setString(ss5.str());
 
-            window.draw(typeText);
-            window.draw(speedText);
-            window.draw(spreadText);
-            window.draw(modeText);
-            window.draw(toggleSimText);
+            // Labels, buttons and the overlay in a handful of draws
+            ui.draw(window);
 
-            for (int i = 0; i < 7; i++) {
-                for (int j = 0; j < 2; j++) {
-                    buttonArr[i][j].drawButton(window);
-                }
-            }
+            traceHud.end();
 
+            recorder.capture(window);
+            TraceScope traceDisplay{ "Display" };
             window.display();
 
         }
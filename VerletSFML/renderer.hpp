@@ -1,5 +1,39 @@
 #pragma once
+#include <array>
+#include <algorithm>
+#include <vector>
 #include "solver.hpp"
+#include "fluid_renderer.hpp"
+
+
+// How a disc is drawn, picked from its radius on screen
+enum class RenderLod : uint8_t
+{
+    // Single pixel, under one pixel of radius
+    Point,
+    // Screen square of the disc diameter, under two pixels
+    Square,
+    // Anti-aliased circle from the sprite atlas, the closest size at or above the disc
+    Sprite,
+    Count
+};
+
+constexpr uint32_t render_lods_count = static_cast<uint32_t>(RenderLod::Count);
+
+const std::string renderLodString[render_lods_count]{
+    "Point",
+    "Square",
+    "Sprite"
+};
+
+struct RenderStats
+{
+    uint64_t vertices   = 0;
+    uint32_t draw_calls = 0;
+    std::array<uint64_t, render_lods_count> discs{};
+    // Particles drawn as part of the liquid surface instead of discs
+    uint64_t fluid      = 0;
+};
 
 
 class Renderer
@@ -9,58 +43,218 @@ public:
     Renderer(sf::RenderTarget& target)
         : m_target{target}
     {
-
+        buildAtlas();
     }
 
-    void render(const Solver& solver) const
+    // `alpha` is how far the display is between the last two simulation updates, 1 draws the latest one
+    void render(const Solver& solver, float alpha = 1.0f)
     {
+        m_stats = {};
+
         // Render constraint
-        /*const sf::Vector3f constraint = solver.getConstraint();
-        sf::CircleShape constraint_background{constraint.z};
-        constraint_background.setOrigin(constraint.z, constraint.z);
-        constraint_background.setFillColor(sf::Color::Black);
-        constraint_background.setPosition(constraint.x, constraint.y);
-        constraint_background.setPointCount(128);
-        m_target.draw(constraint_background);*/
-
-        sf::RectangleShape rectangle(sf::Vector2f(1400.f, 900.f));
-        rectangle.setPosition(50, 50);
-        rectangle.setFillColor(sf::Color::Black);
-        m_target.draw(rectangle);
+        if (solver.getConstraintShape() == ConstraintShape::Circle) {
+            const sf::Vector3f constraint = solver.getConstraint();
+            sf::CircleShape constraint_background{constraint.z};
+            constraint_background.setOrigin(constraint.z, constraint.z);
+            constraint_background.setFillColor(sf::Color::Black);
+            constraint_background.setPosition(constraint.x, constraint.y);
+            constraint_background.setPointCount(128);
+            m_target.draw(constraint_background);
+        }
+        else {
+            const sf::FloatRect bounds = solver.getWorldBounds();
+            sf::RectangleShape rectangle(sf::Vector2f(bounds.width, bounds.height));
+            rectangle.setPosition(bounds.left, bounds.top);
+            rectangle.setFillColor(sf::Color::Black);
+            m_target.draw(rectangle);
+        }
+        m_stats.draw_calls++;
+
+        // Under the discs so that what sinks in stays visible
+        if (m_fluid_mode) {
+            m_fluid.update(solver, alpha);
+            m_fluid.draw(m_target);
+            m_stats.fluid     = m_fluid.getParticlesCount();
+            m_stats.vertices += 4;
+            m_stats.draw_calls++;
+        }
+
+        m_lines.clear();
+        m_points.clear();
+        m_triangles.clear();
 
         // Render links
         const auto& links = solver.getLinks();
         for (const auto& alink : links) {
-            sf::Vertex line[] =
-            {
-                sf::Vertex(solver.m_objects[alink.obj_1].position),
-                sf::Vertex(solver.m_objects[alink.obj_2].position)
-            };
-            m_target.draw(line, 2, sf::Lines);
+            m_lines.emplace_back(solver.m_objects[alink.obj_1].getInterpolatedPosition(alpha));
+            m_lines.emplace_back(solver.m_objects[alink.obj_2].getInterpolatedPosition(alpha));
         }
 
         // Render objects
-        sf::CircleShape circle{1.0f};
-        circle.setPointCount(32);
-        circle.setOrigin(1.0f, 1.0f);
+        const float pixels_per_unit = getPixelsPerUnit();
         const auto& objects = solver.getObjects();
         for (const auto& obj : objects) {
-            circle.setPosition(obj.position);
-            circle.setScale(obj.radius, obj.radius);
-
-            /*if (obj.type == SPAWNER && obj.spawnerType == NONE) {
-                circle.setOutlineThickness(obj.radius);
-                circle.setOutlineColor(sf::Color::White);
-                circle.setFillColor(sf::Color::Transparent);
-            }*/
+            if (m_fluid_mode && FluidRenderer::getLayer(obj.type) < FluidRenderer::layers_count) {
+                continue;
+            }
+            addDisc(obj.getInterpolatedPosition(alpha), obj.radius, obj.getColor(), pixels_per_unit);
+        }
 
-            circle.setFillColor(obj.color);
-            m_target.draw(circle);
+        // Render spawners
+        for (const auto& spawner : solver.getSpawners()) {
+            addDisc(spawner.position, 5.0f, { 101, 2, 158 }, pixels_per_unit);
         }
 
-        
+        // Tiny discs first so that spawners stay on top as before
+        drawBatch(m_lines, sf::Lines);
+        drawBatch(m_points, sf::Points);
+        drawBatch(m_triangles, sf::Triangles, &m_atlas);
+    }
+
+    [[nodiscard]]
+    const RenderStats& getStats() const
+    {
+        return m_stats;
+    }
+
+    // Water and lava as a density surface rather than one disc per particle
+    void setFluidMode(bool enabled)
+    {
+        m_fluid_mode = enabled;
+    }
+
+    [[nodiscard]]
+    bool getFluidMode() const
+    {
+        return m_fluid_mode;
     }
 
 private:
+    // Radii of the circles in the atlas, in texels
+    static constexpr uint32_t sprites_count               = 5;
+    static constexpr float    sprite_radii[sprites_count] = { 4.0f, 8.0f, 16.0f, 32.0f, 64.0f };
+    // Transparent border around every circle so that filtering never reads a neighbour
+    static constexpr float    sprite_padding              = 2.0f;
+    // Edge pixels are split in this many samples per axis to compute their coverage
+    static constexpr uint32_t sprite_samples              = 4;
+
     sf::RenderTarget& m_target;
+    RenderStats       m_stats;
+
+    sf::Texture                              m_atlas;
+    std::array<sf::FloatRect, sprites_count> m_sprite_rects;
+    // Plain white texels for the squares, which share the textured batch
+    sf::FloatRect                            m_white_rect;
+
+    std::vector<sf::Vertex> m_lines;
+    std::vector<sf::Vertex> m_points;
+    std::vector<sf::Vertex> m_triangles;
+
+    FluidRenderer m_fluid;
+    bool          m_fluid_mode = false;
+
+    [[nodiscard]]
+    float getPixelsPerUnit() const
+    {
+        const sf::Vector2f view_size = m_target.getView().getSize();
+        return view_size.x > 0.0f ? static_cast<float>(m_target.getSize().x) / view_size.x : 1.0f;
+    }
+
+    // White circles with their coverage in the alpha channel, tinted by the vertex colour when drawn
+    void buildAtlas()
+    {
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        for (const float radius : sprite_radii) {
+            const uint32_t cell = static_cast<uint32_t>(2.0f * (radius + sprite_padding));
+            width += cell;
+            height = std::max(height, cell);
+        }
+        const uint32_t white_cell = 4;
+        width += white_cell;
+
+        sf::Image image;
+        image.create(width, height, { 255, 255, 255, 0 });
+
+        uint32_t x0 = 0;
+        for (uint32_t k{ 0 }; k < sprites_count; k++) {
+            const float    radius = sprite_radii[k];
+            const uint32_t cell   = static_cast<uint32_t>(2.0f * (radius + sprite_padding));
+            const float    center = 0.5f * cell;
+            for (uint32_t y{ 0 }; y < cell; y++) {
+                for (uint32_t x{ 0 }; x < cell; x++) {
+                    uint32_t inside = 0;
+                    for (uint32_t sy{ 0 }; sy < sprite_samples; sy++) {
+                        for (uint32_t sx{ 0 }; sx < sprite_samples; sx++) {
+                            const float dx = x + (sx + 0.5f) / sprite_samples - center;
+                            const float dy = y + (sy + 0.5f) / sprite_samples - center;
+                            inside += dx * dx + dy * dy <= radius * radius;
+                        }
+                    }
+                    const uint8_t alpha = static_cast<uint8_t>(255 * inside / (sprite_samples * sprite_samples));
+                    image.setPixel(x0 + x, y, { 255, 255, 255, alpha });
+                }
+            }
+            m_sprite_rects[k] = { static_cast<float>(x0), 0.0f, static_cast<float>(cell), static_cast<float>(cell) };
+            x0 += cell;
+        }
+
+        for (uint32_t y{ 0 }; y < white_cell; y++) {
+            for (uint32_t x{ 0 }; x < white_cell; x++) {
+                image.setPixel(x0 + x, y, sf::Color::White);
+            }
+        }
+        // Inner texels only, filtering at the border would blend in the transparent ones
+        m_white_rect = { x0 + 1.0f, 1.0f, white_cell - 2.0f, white_cell - 2.0f };
+
+        m_atlas.loadFromImage(image);
+        m_atlas.setSmooth(true);
+    }
+
+    void addQuad(sf::Vector2f position, float half_size, sf::FloatRect texture_rect, sf::Color color)
+    {
+        const float      u0           = texture_rect.left;
+        const float      v0           = texture_rect.top;
+        const float      u1           = texture_rect.left + texture_rect.width;
+        const float      v1           = texture_rect.top + texture_rect.height;
+        const sf::Vertex top_left     = { position + sf::Vector2f{ -half_size, -half_size }, color, { u0, v0 } };
+        const sf::Vertex top_right    = { position + sf::Vector2f{  half_size, -half_size }, color, { u1, v0 } };
+        const sf::Vertex bottom_left  = { position + sf::Vector2f{ -half_size,  half_size }, color, { u0, v1 } };
+        const sf::Vertex bottom_right = { position + sf::Vector2f{  half_size,  half_size }, color, { u1, v1 } };
+        m_triangles.insert(m_triangles.end(), { top_left, top_right, bottom_left, bottom_left, top_right, bottom_right });
+    }
+
+    void addDisc(sf::Vector2f position, float radius, sf::Color color, float pixels_per_unit)
+    {
+        const float screen_radius = radius * pixels_per_unit;
+        if (screen_radius < 1.0f) {
+            m_stats.discs[static_cast<uint32_t>(RenderLod::Point)]++;
+            m_points.emplace_back(position, color);
+            return;
+        }
+        if (screen_radius < 2.0f) {
+            m_stats.discs[static_cast<uint32_t>(RenderLod::Square)]++;
+            addQuad(position, radius, m_white_rect, color);
+            return;
+        }
+
+        // Minified rather than magnified, which keeps the edges sharp
+        uint32_t sprite = 0;
+        while (sprite + 1 < sprites_count && sprite_radii[sprite] < screen_radius) {
+            sprite++;
+        }
+        m_stats.discs[static_cast<uint32_t>(RenderLod::Sprite)]++;
+        // The quad also covers the padding of the cell
+        addQuad(position, radius * (sprite_radii[sprite] + sprite_padding) / sprite_radii[sprite], m_sprite_rects[sprite], color);
+    }
+
+    void drawBatch(const std::vector<sf::Vertex>& vertices, sf::PrimitiveType type, const sf::Texture* texture = nullptr)
+    {
+        if (vertices.empty()) {
+            return;
+        }
+        m_target.draw(vertices.data(), vertices.size(), type, sf::RenderStates{ texture });
+        m_stats.vertices += vertices.size();
+        m_stats.draw_calls++;
+    }
 };
@@ -1,20 +1,28 @@
 #pragma once
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cmath>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <sstream>
 #include <SFML/Graphics.hpp>
 #include <stdlib.h>
 #include <string>
 
 #include "utils/math.hpp"
+#include "utils/timer_wheel.hpp"
+#include "utils/spatial_grid.hpp"
+#include "utils/spsc_queue.hpp"
+#include "utils/trace.hpp"
+#include "utils/alloc_counter.hpp"
+#include "utils/worker_pool.hpp"
 
 #define NUM_OF_TYPE 14
 
-extern int points[MAXPOINTS][2];
-extern int diff_points[MAXPOINTS][2];
-
-const enum TYPE {
+enum TYPE : uint8_t {
     SAND,
     WATER,
     CONCRETE,
@@ -48,39 +56,199 @@ const std::string typeString[NUM_OF_TYPE]{
     "String"
 };
 
-float typeRadiusArr[NUM_OF_TYPE] = { 6.0f, 3.5f, 10.0f, 4.0f, 1.0f, 4.0f, 4.0f, 10.0f, 1.5f, 1.0f, 999.0f, 999.0f, 999.0f, 1.0f };
+// Everything fixed per type, objects only keep what changes during the simulation
+struct Material
+{
+    float   radius;
+    float   mass;
+    float   bounce;
+    float   friction;
+    // Scales gravity, gases rise
+    float   gravity;
+    // -1 when unused
+    int16_t lifespan;
+    int16_t counter;
+    bool    pinned;
+    bool    fluid;
+    // Brush tools rather than matter, a cluster of them is a single object
+    bool    tool;
+};
+
+constexpr Material materials[NUM_OF_TYPE] = {
+    //  radius  mass   bounce friction gravity lifespan counter pinned fluid  tool
+    {   6.0f,  1.5f,  0.0f,  0.1f,    1.0f,   -1,      -1,     false, false, false },  // SAND
+    {   3.5f,  1.0f,  0.0f,  1.0f,    1.0f,   -1,      -1,     false, true,  false },  // WATER
+    {  10.0f,  3.0f,  0.0f,  0.1f,    1.0f,   -1,      -1,     true,  false, false },  // CONCRETE
+    {   4.0f,  1.25f, 0.0f,  0.8f,    1.0f,   -1,      -1,     false, true,  false },  // LAVA
+    {   1.0f,  0.1f,  0.0f,  1.0f,   -1.0f,    8,      -1,     false, true,  false },  // GAS
+    {   4.0f,  3.0f,  0.0f,  0.0f,    1.0f,   -1,      -1,     false, false, false },  // OBSIDIAN
+    {   4.0f,  1.2f,  0.0f,  0.1f,    1.0f,   -1,      -1,     false, false, false },  // DIRT
+    {  10.0f,  3.0f,  0.0f,  0.1f,    1.0f,   -1,      -1,     true,  false, false },  // WOOD
+    {   1.5f,  0.3f,  0.0f,  0.1f,    1.0f,   10,       1,     false, false, false },  // FIRE
+    {   1.0f,  0.2f,  0.0f,  1.0f,   -1.0f,    8,       1,     false, true,  false },  // FIRE_GAS
+    {   1.0f,  1.0f,  0.0f,  1.0f,    1.0f,   -1,      -1,     false, true,  true  },  // NONE
+    {   1.0f,  1.0f,  0.0f,  1.0f,    1.0f,   -1,      -1,     false, true,  true  },  // SPAWNER
+    {   1.0f,  1.0f,  0.0f,  1.0f,    1.0f,   -1,      -1,     false, true,  true  },  // BLACKHOLE
+    {   1.0f,  1.0f,  0.0f,  1.0f,    1.0f,   -1,      -1,     false, true,  false }   // STRING
+};
+
+// Fluids that keep their volume, handed to the density solver when position based fluids are enabled
+constexpr bool isLiquid(TYPE type)
+{
+    return type == WATER || type == LAVA;
+}
+
+// Special outcomes of two types touching, see Solver::computeReaction
+enum class Reaction : uint8_t
+{
+    None,
+    // Pass through each other
+    Ignore,
+    // Water and lava turn into gas and obsidian
+    Obsidian,
+    // Water and fire turn into gas
+    Steam,
+    // Gas bubbles up through water
+    Bubble,
+    // Wood catching fire from fire or fire gas
+    Ignite,
+    IgniteFromGas
+};
+
+constexpr Reaction getReaction(TYPE a, TYPE b)
+{
+    auto is = [a, b](TYPE x, TYPE y) { return (a == x && b == y) || (a == y && b == x); };
+
+    if (is(GAS, OBSIDIAN) || is(GAS, FIRE) || is(FIRE_GAS, FIRE) || is(FIRE_GAS, GAS) || is(FIRE_GAS, FIRE_GAS) || is(FIRE, LAVA)) {
+        return Reaction::Ignore;
+    }
+    if (is(WATER, LAVA)) {
+        return Reaction::Obsidian;
+    }
+    if (is(WATER, FIRE)) {
+        return Reaction::Steam;
+    }
+    if (is(GAS, WATER)) {
+        return Reaction::Bubble;
+    }
+    if (is(WOOD, FIRE)) {
+        return Reaction::Ignite;
+    }
+    if (is(WOOD, FIRE_GAS)) {
+        return Reaction::IgniteFromGas;
+    }
+    return Reaction::None;
+}
+
+struct ReactionTable
+{
+    Reaction pairs[NUM_OF_TYPE][NUM_OF_TYPE];
+};
+
+constexpr ReactionTable makeReactionTable()
+{
+    ReactionTable table{};
+    for (int a{ 0 }; a < NUM_OF_TYPE; a++) {
+        for (int b{ 0 }; b < NUM_OF_TYPE; b++) {
+            table.pairs[a][b] = getReaction(static_cast<TYPE>(a), static_cast<TYPE>(b));
+        }
+    }
+    return table;
+}
 
-sf::Vector2i currentMousePos;
-sf::Vector2i lastMousePos;
+// Built by the compiler, the collision loop does one lookup instead of a chain of type tests
+constexpr ReactionTable reactions = makeReactionTable();
+
+// Objects store an index in this palette, the first NUM_OF_TYPE entries are the default colour of each type
+const uint8_t DARK_GAS_COLOR = NUM_OF_TYPE;
+
+const sf::Color palette[NUM_OF_TYPE + 1] = {
+    { 255, 255, 0 },    // SAND
+    { 0, 0, 255 },      // WATER
+    { 100, 100, 100 },  // CONCRETE
+    { 255, 69, 0 },     // LAVA
+    { 200, 200, 200 },  // GAS
+    { 50, 50, 50 },     // OBSIDIAN
+    { 84, 28, 0 },      // DIRT
+    { 227, 159, 64 },   // WOOD
+    { 227, 38, 5 },     // FIRE
+    { 150, 150, 150 },  // FIRE_GAS
+    { 255, 255, 255 },  // NONE
+    { 255, 255, 255 },  // SPAWNER
+    { 255, 255, 255 },  // BLACKHOLE
+    { 255, 255, 255 },  // STRING
+    { 150, 150, 150 }   // DARK_GAS_COLOR
+};
 
+// Kept small since there can be millions of them, per type constants live in `materials`
 struct VerletObject
 {
     sf::Vector2f position;
     sf::Vector2f position_last;
+    // Where the last update started from, the renderer interpolates towards `position`
+    sf::Vector2f position_before_update;
     sf::Vector2f acceleration;
-    float        mass          = 1.0f;
-    float        bounce        = 0.0f;
+    // Radius and mass are per type too, except for the weight at the end of strings
     float        radius        = 10.0f;
-    sf::Color    color         = sf::Color::White;
-    bool         pinned        = false;
+    float        mass          = 1.0f;
+    uint32_t     handle        = 0;
+    uint32_t     chunk         = 0;
+    int16_t      lifespan      = -1;
+    int16_t      counter       = -1;
     TYPE         type          = NONE;
-    float        frictionCoeff = 1.0f;
-    bool         isFluid       = true;
-    bool         grounded      = false;
-    int          lifespan      = -1;
-    int          counter       = -1;
-    TYPE         spawnerType   = NONE;
-
-    VerletObject() = default;
+    // Index in `palette`
+    uint8_t      color         = NONE;
+    bool         pinned   : 1;
+    bool         grounded : 1;
+    bool         isFluid  : 1;
+    bool         removed  : 1;
+
+    VerletObject()
+        : pinned{false}
+        , grounded{false}
+        , isFluid{true}
+        , removed{false}
+    {}
+
     VerletObject(sf::Vector2f position_, float radius_, bool pin_, TYPE type_)
         : position{position_}
         , position_last{position_}
+        , position_before_update{position_}
         , acceleration{0.0f, 0.0f}
         , radius{radius_}
-        , pinned{pin_}
         , type{type_}
+        , color{type_}
+        , pinned{pin_}
+        , grounded{false}
+        , isFluid{true}
+        , removed{false}
     {}
 
+    // `alpha` is the fraction of an update elapsed since the last one, 1 shows the current state
+    [[nodiscard]]
+    sf::Vector2f getInterpolatedPosition(float alpha) const
+    {
+        return position_before_update + (position - position_before_update) * alpha;
+    }
+
+    [[nodiscard]]
+    float getFriction() const
+    {
+        return materials[type].friction;
+    }
+
+    [[nodiscard]]
+    float getBounce() const
+    {
+        return materials[type].bounce;
+    }
+
+    [[nodiscard]]
+    sf::Color getColor() const
+    {
+        return palette[color];
+    }
+
     void update(float dt)
     {
         // Compute how much we moved
@@ -115,6 +283,157 @@ struct VerletObject
 };
 
 
+// Stable reference to an object, survives the index shifts caused by erasing
+struct ObjectHandle
+{
+    uint32_t id         = 0;
+    uint32_t generation = 0;
+};
+
+
+enum class TimerEvent : uint8_t
+{
+    Lifespan,
+    Emission
+};
+
+
+struct ObjectTimer
+{
+    ObjectHandle handle;
+    TimerEvent   event;
+};
+
+
+// Spawners live outside of the particle storage so particle passes never see them.
+// NONE spawners push particles away, BLACKHOLE ones pull them in, any other type is emitted every `delay` frames.
+struct Spawner
+{
+    sf::Vector2f position;
+    TYPE         spawnerType = NONE;
+    int          delay       = -1;
+    float        radius      = 0.0f;
+    float        power       = 1.0f;
+
+    Spawner() = default;
+    Spawner(sf::Vector2f position_, TYPE spawnerType_, int delay_, float radius_, float power_)
+        : position{position_}
+        , spawnerType{spawnerType_}
+        , delay{delay_}
+        , radius{radius_}
+        , power{power_}
+    {}
+};
+
+
+enum class ConstraintShape : uint8_t
+{
+    Box,
+    Circle
+};
+
+
+struct TouchPoint
+{
+    sf::Vector2f position;
+};
+
+
+enum class InputEventType : uint8_t
+{
+    TouchMove,
+    TouchUp
+};
+
+
+// Platform independent input, `contact` is the touch slot chosen by the producer
+struct InputEvent
+{
+    InputEventType type     = InputEventType::TouchMove;
+    uint32_t       contact  = 0;
+    sf::Vector2f   position;
+};
+
+
+using InputQueue = SpscQueue<InputEvent, 1024>;
+
+
+enum class SolverPhase : uint8_t
+{
+    Chunks,
+    Gravity,
+    Collisions,
+    Fluids,
+    Constraint,
+    Links,
+    Integration,
+    Timers,
+    Spawners,
+    Count
+};
+
+constexpr uint32_t solver_phases_count = static_cast<uint32_t>(SolverPhase::Count);
+
+const char* const solverPhaseString[solver_phases_count]{
+    "Chunks",
+    "Gravity",
+    "Collisions",
+    "Fluids",
+    "Constraint",
+    "Links",
+    "Integration",
+    "Timers",
+    "Spawners"
+};
+
+
+// Filled by every update
+struct SolverStats
+{
+    uint32_t sub_steps       = 0;
+    // Largest displacement over the previous frame, in radii of the moving object, gas and fire left out
+    float    max_motion      = 0.0f;
+    // Deepest penetration over the previous frame, in radii of the smallest object
+    float    max_overlap     = 0.0f;
+    uint64_t active_objects  = 0;
+    uint64_t awake_chunks    = 0;
+    // Overlapping pairs resolved over all the sub steps
+    uint64_t collision_pairs = 0;
+    uint64_t links           = 0;
+    // Milliseconds spent in each phase, summed over the sub steps
+    float    update_ms       = 0.0f;
+    std::array<float, solver_phases_count> phase_ms{};
+    // Kept up to date on every insertion and removal
+    std::array<uint64_t, NUM_OF_TYPE>      type_counts{};
+    // Objects created and removed since the previous update, by the player, spawners and reactions alike
+    uint64_t spawned         = 0;
+    uint64_t removed         = 0;
+    // Heap allocations made during the update, 0 unless the AllocCounter hook is compiled in
+    uint64_t allocations     = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+// What the solver containers hold on to, capacities included since the storage never shrinks by itself
+struct SolverMemory
+{
+    uint64_t objects          = 0;
+    uint64_t objects_capacity = 0;
+    uint64_t object_bytes     = 0;
+    uint64_t links            = 0;
+    uint64_t links_capacity   = 0;
+    uint64_t link_bytes       = 0;
+    uint64_t spawner_bytes    = 0;
+    // Handles, chunks, timers, simulated lists and the collision grid
+    uint64_t index_bytes      = 0;
+
+    [[nodiscard]]
+    uint64_t getTotalBytes() const
+    {
+        return object_bytes + link_bytes + spawner_bytes + index_bytes;
+    }
+};
+
+
 struct Link
 {
     int obj_1;
@@ -137,129 +456,94 @@ class Solver
 public:
     Solver() = default;
 
+    // Times the private passes one at a time, see Benchmark/kernels.hpp
+    friend struct SolverBenchmark;
+
     VerletObject& addObject(sf::Vector2f position, TYPE type)
     {
-        VerletObject obj = {position, 1.f, false, type};
-        switch (type)
-        {
-        case SAND:
-            obj.color = { 255,255,0 };
-            obj.radius = 6.0f;
-            obj.pinned = false;
-            obj.mass = 1.5f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.1f;
-            obj.isFluid = false;
-            break;
-        case WATER:
-            obj.color = { 0,0,255 };
-            obj.radius = 3.5f;
-            obj.pinned = false;
-            obj.mass = 1.0f;
-            obj.bounce = 0.0f;
-            break;
-        case CONCRETE:
-            obj.color = { 100,100,100 };
-            obj.radius = 10.0f;
-            obj.pinned = true;
-            obj.mass = 3.0f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.1f;
-            obj.isFluid = false;
-            break;
-        case LAVA:
-            obj.color = { 255,69,0 };
-            obj.radius = 4.0f;
-            obj.pinned = false;
-            obj.mass = 1.25f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.8f;
-            break;
-        case GAS:
-            obj.color = { 200,200,200 };
-            obj.radius = 1.0f;
-            obj.pinned = false;
-            obj.mass = 0.1f;
-            obj.bounce = 0.0f;
-            obj.lifespan = 8;
-            break;
-        case OBSIDIAN:
-            obj.color = {50,50,50};
-            obj.radius = 4.0f;
-            obj.pinned = false;
-            obj.mass = 3.0f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.0f;
-            obj.isFluid = false;
-            break;
-        case DIRT:
-            obj.color = { 84, 28, 0 };
-            obj.radius = 4.0f;
-            obj.pinned = false;
-            obj.mass = 1.2f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.1f;
-            obj.isFluid = false;
-            break;
-        case WOOD:
-            obj.color = { 227, 159, 64 };
-            obj.radius = 10.0f;
-            obj.pinned = true;
-            obj.mass = 3.0f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.1f;
-            obj.isFluid = false;
-            break;
-        case FIRE:
-            obj.color = { 227, 38, 5 };
-            obj.radius = 1.5f;
-            obj.pinned = false;
-            obj.mass = 0.3f;
-            obj.bounce = 0.0f;
-            obj.frictionCoeff = 0.1f;
-            obj.lifespan = 10;
-            obj.isFluid = false;
-            obj.counter = 1;
-            break;
-        case FIRE_GAS:
-            obj.color = { 150,150,150 };
-            obj.radius = 1.0f;
-            obj.pinned = false;
-            obj.mass = 0.2f;
-            obj.bounce = 0.0f;
-            obj.lifespan = 8;
-            obj.counter = 1;
-            break;
-        case SPAWNER:
-            obj.color = { 101, 2, 158 };
-            obj.radius = 5.0f;
-            obj.pinned = true;
-            break;
-        case STRING:
-            obj.color = sf::Color::White;
-            obj.radius = typeRadiusArr[STRING];
-            obj.pinned = false;
-            break;
-        default:
-            obj.color = sf::Color::White;
-            obj.radius = 1.0f;
-            obj.pinned = false;
-            obj.mass = 1.0f;
-            obj.bounce = 0.0f;
-            break;
+        return m_objects[addObjects(1, type, [position](uint64_t) { return position; })];
+    }
+
+    // Creates `count` objects of one type with a single reservation, get_position(i) places the i-th one.
+    // Returns the index of the first one, the others follow it in m_objects.
+    template<typename TPositionGetter>
+    uint64_t addObjects(uint64_t count, TYPE type, TPositionGetter&& get_position)
+    {
+        const uint64_t first = m_objects.size();
+        reserveFor(m_objects, count);
+        reserveFor(m_new_objects, count);
+
+        const Material& material = materials[type];
+        VerletObject prototype = {{}, material.radius, material.pinned, type};
+        prototype.mass     = material.mass;
+        prototype.isFluid  = material.fluid;
+        prototype.lifespan = material.lifespan;
+        prototype.counter  = material.counter;
+
+        m_stats.type_counts[type] += count;
+        m_spawned_total           += count;
+        for (uint64_t i{ 0 }; i < count; i++) {
+            VerletObject& obj = m_objects.emplace_back(prototype);
+            obj.position      = get_position(i);
+            obj.position_last = obj.position;
+            obj.position_before_update = obj.position;
+            obj.handle        = allocateHandle(first + i);
+            // Simulated from the next frame on, once it has been put in its chunk
+            m_new_objects.push_back(getHandle(obj));
+            scheduleTimers(obj);
         }
-        return m_objects.emplace_back(obj);
+        return first;
     }
 
     void addObjectCluster(sf::Vector2f pos, TYPE type, float size) {
-        float halfSize = size / 2.0f;
-        float increment = 2.0 * typeRadiusArr[type] - 0.05f;
-        for (float i = -halfSize; i <= halfSize; i += increment) {
-            for (float j = -halfSize; j <= halfSize; j += increment) {
-                sf::Vector2f temp = { i,j };
-                addObject(pos + temp, type);
+        if (materials[type].tool) {
+            addObject(pos, type);
+            return;
+        }
+        const float halfSize = size / 2.0f;
+        const float increment = 2.0f * materials[type].radius - 0.05f;
+        const uint64_t side = static_cast<uint64_t>(size / increment) + 1;
+        addObjects(side * side, type, [&](uint64_t i) {
+            return pos + sf::Vector2f{ -halfSize + (i / side) * increment, -halfSize + (i % side) * increment };
+        });
+    }
+
+    // Rope through `points`, each object linked to the previous one. Returns the index of the first object.
+    uint64_t addChain(const std::vector<sf::Vector2f>& points, TYPE type)
+    {
+        const uint64_t first = addObjects(points.size(), type, [&](uint64_t i) { return points[i]; });
+        reserveFor(m_links, points.size());
+        for (uint64_t i{ 1 }; i < points.size(); i++) {
+            addLink(static_cast<int>(first + i - 1), static_cast<int>(first + i));
+        }
+        return first;
+    }
+
+    // Grid of columns x rows objects linked to their horizontal and vertical neighbours,
+    // object (x, y) is at first + x * rows + y. Returns the index of the first object.
+    uint64_t addCloth(sf::Vector2f origin, uint32_t columns, uint32_t rows, float spacing, TYPE type)
+    {
+        const uint64_t first = addObjects(static_cast<uint64_t>(columns) * rows, type, [&](uint64_t i) {
+            return origin + sf::Vector2f{ (i / rows) * spacing, (i % rows) * spacing };
+        });
+        reserveFor(m_links, 2 * static_cast<uint64_t>(columns) * rows);
+        for (uint32_t x{ 0 }; x < columns; x++) {
+            for (uint32_t y{ 0 }; y < rows; y++) {
+                const int index = static_cast<int>(first + static_cast<uint64_t>(x) * rows + y);
+                if (y > 0) {
+                    addLink(index - 1, index);
+                }
+                if (x > 0) {
+                    addLink(index - static_cast<int>(rows), index);
+                }
             }
         }
+        return first;
+    }
+
+    Spawner& addSpawner(sf::Vector2f position, TYPE type, int delay, float radius, float power)
+    {
+        return m_spawners.emplace_back(position, type, delay, radius, power);
     }
 
     Link& addLink(int obj1, int obj2) 
@@ -272,22 +556,48 @@ public:
     void update(bool canUpdate)
     {
         m_time += m_frame_dt;
-        const float step_dt = getStepDt();
 
         if (canUpdate) {
+            TraceScope trace{ "Solver update" };
+            const auto start       = std::chrono::steady_clock::now();
+            const auto allocations = AllocCounter::get();
+            m_stats.phase_ms.fill(0.0f);
+            m_stats.collision_pairs = 0;
+            // Timers and spawners count simulation updates, not displayed frames
+            m_frame_num++;
+
+            timePhase(SolverPhase::Chunks, [this] { updateChunks(); });
+            updateSubSteps();
+
+            const float step_dt = getStepDt();
+            m_max_overlap = 0.0f;
             for (uint32_t i{ m_sub_steps }; i--;) {
-                applyGravity();
-                //applyTouchForce();
-                checkCollisions(step_dt);
-                applyConstraint(step_dt);
-                applyLinkConstraint(step_dt);
-                updateObjects(step_dt);
+                timePhase(SolverPhase::Gravity, [this] { applyGravity(); });
+                timePhase(SolverPhase::Collisions, [&] { checkCollisions(step_dt); });
+                if (m_position_based_fluids) {
+                    timePhase(SolverPhase::Fluids, [this] { solveFluids(); });
+                }
+                timePhase(SolverPhase::Constraint, [&] { applyConstraint(step_dt); });
+                timePhase(SolverPhase::Links, [&] { applyLinkConstraint(step_dt); });
+                timePhase(SolverPhase::Integration, [&] { updateObjects(step_dt); });
             }
 
-            updateSpawner();
+            timePhase(SolverPhase::Timers, [this] { updateTimers(); });
+            timePhase(SolverPhase::Spawners, [this] { updateSpawner(); });
+
+            m_stats.links     = m_links.size();
+            m_stats.update_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            const AllocCounter::Snapshot update_allocations = AllocCounter::since(allocations);
+            m_stats.allocations     = update_allocations.allocations;
+            m_stats.allocated_bytes = update_allocations.allocated_bytes;
+            m_stats.spawned         = m_spawned_total - m_spawned_reported;
+            m_stats.removed         = m_removed_total - m_removed_reported;
+            m_spawned_reported      = m_spawned_total;
+            m_removed_reported      = m_removed_total;
         }
 
-        lastMousePos = currentMousePos;
+        m_last_mouse_pos = m_mouse_pos;
     }
 
     void setSimulationUpdateRate(uint32_t rate)
@@ -295,15 +605,60 @@ public:
         m_frame_dt = 1.0f / static_cast<float>(rate);
     }
 
+    // Circular container
     void setConstraint(sf::Vector2f position, float radius)
     {
+        m_constraint_shape  = ConstraintShape::Circle;
         m_constraint_center = position;
         m_constraint_radius = radius;
+        m_chunks_valid      = false;
+    }
+
+    // Rectangular container, `position` is its top left corner
+    void setWorldBounds(sf::Vector2f position, sf::Vector2f size)
+    {
+        m_constraint_shape = ConstraintShape::Box;
+        m_world_min        = position;
+        m_world_max        = position + size;
+        m_chunks_valid     = false;
+    }
+
+    // Reactions, emissions and spawners draw from this, a fixed seed replays the same run
+    void setRandomSeed(uint32_t seed)
+    {
+        m_rng.seed(seed);
+    }
+
+    // Chunks without motion, spawners or input stop being simulated when enabled, off by default
+    void setChunkSleeping(bool enabled)
+    {
+        m_chunk_sleeping = enabled;
+    }
+
+    // Liquids keep their volume through a density constraint instead of pairwise collisions between their particles
+    void setPositionBasedFluids(bool enabled)
+    {
+        m_position_based_fluids = enabled;
+    }
+
+    [[nodiscard]]
+    bool getPositionBasedFluids() const
+    {
+        return m_position_based_fluids;
     }
 
     void setSubStepsCount(uint32_t sub_steps)
     {
-        m_sub_steps = sub_steps;
+        m_sub_steps          = sub_steps;
+        m_adaptive_sub_steps = false;
+    }
+
+    // The count is then chosen every frame from how fast objects move and how deep they overlap
+    void setAdaptiveSubSteps(uint32_t min_sub_steps, uint32_t max_sub_steps)
+    {
+        m_min_sub_steps      = std::max(1u, min_sub_steps);
+        m_max_sub_steps      = std::max(m_min_sub_steps, max_sub_steps);
+        m_adaptive_sub_steps = true;
     }
 
     void setObjectVelocity(VerletObject& object, sf::Vector2f v)
@@ -317,6 +672,12 @@ public:
         return m_objects;
     }
 
+    [[nodiscard]]
+    const std::vector<Spawner>& getSpawners() const
+    {
+        return m_spawners;
+    }
+
     [[nodiscard]]
     const std::vector<Link>& getLinks() const
     {
@@ -329,12 +690,73 @@ public:
         return {m_constraint_center.x, m_constraint_center.y, m_constraint_radius};
     }
 
+    [[nodiscard]]
+    sf::FloatRect getWorldBounds() const
+    {
+        return {m_world_min.x, m_world_min.y, m_world_max.x - m_world_min.x, m_world_max.y - m_world_min.y};
+    }
+
+    [[nodiscard]]
+    ConstraintShape getConstraintShape() const
+    {
+        return m_constraint_shape;
+    }
+
     [[nodiscard]]
     uint64_t getObjectsCount() const
     {
         return m_objects.size();
     }
 
+    [[nodiscard]]
+    const SolverStats& getStats() const
+    {
+        return m_stats;
+    }
+
+    // Walks the chunks, meant for overlays and reports rather than every frame
+    [[nodiscard]]
+    SolverMemory getMemory() const
+    {
+        SolverMemory memory;
+        memory.objects          = m_objects.size();
+        memory.objects_capacity = m_objects.capacity();
+        memory.object_bytes     = getCapacityBytes(m_objects);
+        memory.links            = m_links.size();
+        memory.links_capacity   = m_links.capacity();
+        memory.link_bytes       = getCapacityBytes(m_links);
+        memory.spawner_bytes    = getCapacityBytes(m_spawners);
+
+        memory.index_bytes = getCapacityBytes(m_handle_slots) + getCapacityBytes(m_free_handles) + getCapacityBytes(m_chunks)
+                           + getCapacityBytes(m_active) + getCapacityBytes(m_border) + getCapacityBytes(m_new_objects)
+                           + getCapacityBytes(m_colliders) + getCapacityBytes(m_index_remap)
+                           + getCapacityBytes(m_fluid_objects) + getCapacityBytes(m_fluid_neighbours_start) + getCapacityBytes(m_fluid_neighbours)
+                           + getCapacityBytes(m_fluid_gradients) + getCapacityBytes(m_fluid_particles) + getCapacityBytes(m_fluid_corrections)
+                           + m_timers.getMemoryBytes() + m_collision_grid.getMemoryBytes() + m_fluid_grid.getMemoryBytes();
+        for (const Chunk& chunk : m_chunks) {
+            memory.index_bytes += getCapacityBytes(chunk.objects);
+        }
+        return memory;
+    }
+
+    [[nodiscard]]
+    uint64_t getActiveObjectsCount() const
+    {
+        return m_active.size();
+    }
+
+    [[nodiscard]]
+    uint64_t getChunksCount() const
+    {
+        return m_chunks.size();
+    }
+
+    [[nodiscard]]
+    uint64_t getAwakeChunksCount() const
+    {
+        return std::count_if(m_chunks.begin(), m_chunks.end(), [](const Chunk& chunk) { return chunk.awake; });
+    }
+
     [[nodiscard]]
     float getTime() const
     {
@@ -353,188 +775,303 @@ public:
         return m_frame_num;
     }
 
+    [[nodiscard]]
+    ObjectHandle getHandle(const VerletObject& obj) const
+    {
+        return {obj.handle, m_handle_slots[obj.handle].generation};
+    }
+
+    [[nodiscard]]
+    ObjectHandle getHandle(uint64_t index) const
+    {
+        return getHandle(m_objects[index]);
+    }
+
+    // Returns nullptr if the object has been deleted since the handle was taken
+    [[nodiscard]]
+    VerletObject* getObject(ObjectHandle handle)
+    {
+        if (handle.id >= m_handle_slots.size() || m_handle_slots[handle.id].generation != handle.generation) {
+            return nullptr;
+        }
+        return &m_objects[m_handle_slots[handle.id].index];
+    }
+
     std::vector<VerletObject> m_objects;
     std::vector<Link>         m_links;
 
     void updateMousePos(sf::Vector2i mousePos) {
-        currentMousePos = mousePos;
-    }
-
-    void updateFrameNum(unsigned int n) {
-        m_frame_num = n;
+        m_mouse_pos = mousePos;
     }
 
     void applyMouseForce() {
-        for (VerletObject& obj : m_objects) {
+        sf::Vector2f targetPos = { (float)m_mouse_pos.x, (float)m_mouse_pos.y };
+        wakeRegion(targetPos, 250.0f);
+        queryChunks(targetPos, 250.0f, [&](VerletObject& obj) {
             if (obj.pinned) {
-                continue;
+                return;
             }
 
-            sf::Vector2f targetPos = { (float)currentMousePos.x, (float)currentMousePos.y };
             sf::Vector2f target = targetPos - obj.position;
-            sf::Vector2f moveVec = {   (float)currentMousePos.x - (float)lastMousePos.x,
-                                        (float)currentMousePos.y - (float)lastMousePos.y 
+            sf::Vector2f moveVec = {   (float)m_mouse_pos.x - (float)m_last_mouse_pos.x,
+                                        (float)m_mouse_pos.y - (float)m_last_mouse_pos.y 
                                     };
             sf::Vector2f velocityVec = moveVec / getStepDt();
             float distance = sqrt(target.x * target.x + target.y * target.y);
             if (distance < 250) {
                 obj.accelerate(velocityVec * 10.0f);
             }
-        }
+        });
     }
 
     void applyForce(sf::Vector2f currentPos) {
-        for (VerletObject& obj : m_objects) {
+        wakeRegion(currentPos, touch_radius);
+        queryChunks(currentPos, touch_radius, [&](VerletObject& obj) {
             if (obj.pinned) {
-                continue;
+                return;
             }
             sf::Vector2f v = currentPos - obj.position;
             float dist2 = v.x * v.x + v.y * v.y;
-            float dist = sqrt(dist2);
-            if (dist < 150) {
+            if (dist2 < touch_radius * touch_radius) {
                 obj.accelerate(v * 60.0f);
             }
-        }
+        });
     }
 
-    void applyPushForce(sf::Vector2f currentPos, float radius) {
-        for (VerletObject& obj : m_objects) {
-            if (obj.pinned) {
+    // Drains the input queue, call it between two updates
+    void processInput(InputQueue& queue)
+    {
+        InputEvent event;
+        while (queue.pop(event)) {
+            if (event.contact >= max_touch_points) {
                 continue;
             }
-            sf::Vector2f v = obj.position - currentPos;
-            float dist2 = v.x * v.x + v.y * v.y;
-            float dist = sqrt(dist2);
-            if (dist < radius) {
-                //obj.setVelocity({ 0,0 }, getStepDt());
-                obj.addVelocity(v * 10.0f * ((radius - dist) / radius), getStepDt());
-            }
-        }
-    }
 
-    void applyCentripetalForce(sf::Vector2f currentPos, float radius, float power) {
-        for (VerletObject& obj : m_objects) {
-            if (obj.pinned || obj.type == SPAWNER) {
+            TouchContact& contact = m_touch_contacts[event.contact];
+            if (event.type == InputEventType::TouchUp) {
+                contact = {};
                 continue;
             }
-            
-            sf::Vector2f v = currentPos - obj.position;
-            float dist2 = v.x * v.x + v.y * v.y;
-            float dist = sqrt(dist2);
-            sf::Vector2f n = getNormalizedVector(v);
-                        
-            //float quadRadius = radius * 4.0f;
-            //float doubleRadius = radius * 2.0f;
 
-            sf::Vector2f acceleration = (power * 300.0f * obj.mass / (dist * 5.0f)) * n;
-            sf::Vector2f velocity = { n.y, -n.x };
-            float a = getVectorMagnitude(acceleration);
-            float speed = sqrtf((a * dist) / obj.mass);
-            velocity *= speed;
+            contact.position = event.position;
+            contact.active   = true;
+        }
 
-            if (dist < radius * 1.5f) {
-                obj.addVelocity(velocity * 2.0f, getStepDt());
-                obj.addVelocity((obj.position.y > currentPos.y ? acceleration * 2.0f : acceleration) , getStepDt());
-            }
-            else if (dist < radius * 5.0f) {
-                obj.addVelocity(acceleration * 75.0f, getStepDt());
+        // Only active contacts, the slots of lifted fingers are skipped entirely
+        m_touch_points.clear();
+        for (const TouchContact& contact : m_touch_contacts) {
+            if (contact.active) {
+                m_touch_points.push_back({ contact.position });
             }
+        }
+    }
 
-            /*if (dist < radius) {
-                sf::Vector2f oldVel = obj.getVelocity(getStepDt());
-                sf::Vector2f newVel = { -oldVel.y, oldVel.x };
-                obj.setVelocity({ 0,0 }, getStepDt());
-                obj.setVelocity(newVel, getStepDt());
+    [[nodiscard]]
+    const std::vector<TouchPoint>& getTouchPoints() const
+    {
+        return m_touch_points;
+    }
 
-                sf::Vector2f newVec = obj.position - currentPos;
-                obj.addVelocity(newVec * 10.0f * ((radius - dist) / radius), getStepDt());
-            }*/
+    // Position of the finger tracked in `contact`, false once it is lifted
+    [[nodiscard]]
+    bool getTouchContact(uint32_t contact, sf::Vector2f& position) const
+    {
+        if (contact >= max_touch_points || !m_touch_contacts[contact].active) {
+            return false;
         }
+        position = m_touch_contacts[contact].position;
+        return true;
     }
 
-    sf::Vector2i getCurrentMousePos() {
-        return currentMousePos;
+    void applyPushForce(sf::Vector2f currentPos, float radius) {
+        wakeRegion(currentPos, radius);
+        queryChunks(currentPos, radius, [&](VerletObject& obj) {
+            applyPushForce(obj, currentPos, radius);
+        });
     }
 
-    sf::Vector2f getCurrentMousePosF() {
-        sf::Vector2i mousePosInt = getCurrentMousePos();
-        sf::Vector2f mousePosF = { (float)mousePosInt.x, (float)mousePosInt.y };
-        return mousePosF;
+    void applyCentripetalForce(sf::Vector2f currentPos, float radius, float power) {
+        wakeRegion(currentPos, radius * 5.0f);
+        queryChunks(currentPos, radius * 5.0f, [&](VerletObject& obj) {
+            applyCentripetalForce(obj, currentPos, radius, power);
+        });
     }
 
-    void deleteBrush(float radius) {
-        for (uint64_t i = 0; i < m_objects.size(); i++) {
-            VerletObject& obj = m_objects[i];
-
-            float distance = sqrt((currentMousePos.x - obj.position.x) * (currentMousePos.x - obj.position.x)
-                                + (currentMousePos.y - obj.position.y) * (currentMousePos.y - obj.position.y));
-            if (distance < radius) {
-                m_objects.erase(m_objects.begin() + i--);
-            }
+    void applyPushForce(VerletObject& obj, sf::Vector2f currentPos, float radius) {
+        if (obj.pinned) {
+            return;
+        }
+        sf::Vector2f v = obj.position - currentPos;
+        float dist2 = v.x * v.x + v.y * v.y;
+        float dist = sqrt(dist2);
+        if (dist < radius) {
+            //obj.setVelocity({ 0,0 }, getStepDt());
+            obj.addVelocity(v * 10.0f * ((radius - dist) / radius), getStepDt());
         }
     }
 
-    void deleteBrush(float radius, sf::Vector2f pos) {
-        for (uint64_t i = 0; i < m_objects.size(); i++) {
-            VerletObject& obj = m_objects[i];
-
-            float distance = sqrt((pos.x - obj.position.x) * (pos.x - obj.position.x)
-                + (pos.y - obj.position.y) * (pos.y - obj.position.y));
-            if (distance < radius) {
-                m_objects.erase(m_objects.begin() + i--);
-            }
+    void applyCentripetalForce(VerletObject& obj, sf::Vector2f currentPos, float radius, float power) {
+        if (obj.pinned) {
+            return;
+        }
+        
+        sf::Vector2f v = currentPos - obj.position;
+        float dist2 = v.x * v.x + v.y * v.y;
+        float dist = sqrt(dist2);
+        sf::Vector2f n = getNormalizedVector(v);
+                    
+        //float quadRadius = radius * 4.0f;
+        //float doubleRadius = radius * 2.0f;
+
+        sf::Vector2f acceleration = (power * 300.0f * obj.mass / (dist * 5.0f)) * n;
+        sf::Vector2f velocity = { n.y, -n.x };
+        float a = getVectorMagnitude(acceleration);
+        float speed = sqrtf((a * dist) / obj.mass);
+        velocity *= speed;
+
+        if (dist < radius * 1.5f) {
+            obj.addVelocity(velocity * 2.0f, getStepDt());
+            obj.addVelocity((obj.position.y > currentPos.y ? acceleration * 2.0f : acceleration) , getStepDt());
         }
+        else if (dist < radius * 5.0f) {
+            obj.addVelocity(acceleration * 75.0f, getStepDt());
+        }
+
+        /*if (dist < radius) {
+            sf::Vector2f oldVel = obj.getVelocity(getStepDt());
+            sf::Vector2f newVel = { -oldVel.y, oldVel.x };
+            obj.setVelocity({ 0,0 }, getStepDt());
+            obj.setVelocity(newVel, getStepDt());
+
+            sf::Vector2f newVec = obj.position - currentPos;
+            obj.addVelocity(newVec * 10.0f * ((radius - dist) / radius), getStepDt());
+        }*/
     }
 
-    void deleteObjectsOfType(TYPE type) {
-        for (uint64_t i{ 0 }; i < m_objects.size(); i++) {
-            VerletObject& obj = m_objects[i];
+    sf::Vector2i getCurrentMousePos() {
+        return m_mouse_pos;
+    }
 
-            if (type == GAS) {
-                if (obj.type == FIRE_GAS || obj.type == GAS) {
-                    m_objects.erase(m_objects.begin() + i--);
+    sf::Vector2f getCurrentMousePosF() {
+        sf::Vector2i mousePosInt = getCurrentMousePos();
+        sf::Vector2f mousePosF = { (float)mousePosInt.x, (float)mousePosInt.y };
+        return mousePosF;
+    }
+
+    // Removes every object matching `predicate` in a single compaction pass, links and handles follow.
+    // With `parallel` the predicate is evaluated on the worker pool, it must then be free of side effects.
+    // Returns the number of removed objects.
+    template<typename TPredicate>
+    uint64_t removeIf(TPredicate&& predicate, bool parallel = false)
+    {
+        const uint64_t objects_count = m_objects.size();
+        const uint32_t slices_count  = parallel && objects_count >= parallel_remove_min_objects
+                                     ? WorkerPool::get().getThreadsCount()
+                                     : 1;
+
+        // Each slice records its first match, the compaction starts at the lowest one
+        std::vector<uint64_t> first_match(slices_count, objects_count);
+        const auto mark_slice = [&](uint32_t slice) {
+            const uint64_t begin = objects_count * slice / slices_count;
+            const uint64_t end   = objects_count * (slice + 1) / slices_count;
+            for (uint64_t i{ begin }; i < end; i++) {
+                VerletObject& obj = m_objects[i];
+                if (!obj.removed && predicate(static_cast<const VerletObject&>(obj))) {
+                    obj.removed = true;
+                    first_match[slice] = std::min(first_match[slice], i);
                 }
-                continue;
             }
+        };
 
-            if (obj.type == type) {
-                m_objects.erase(m_objects.begin() + i--);
+        if (slices_count > 1) {
+            WorkerPool::get().forEachSlice(slices_count, mark_slice);
+        }
+        else {
+            mark_slice(0);
+        }
 
-            }
+        const uint64_t first = *std::min_element(first_match.begin(), first_match.end());
+        if (first < objects_count) {
+            m_first_removed = m_has_removed ? std::min(m_first_removed, first) : first;
+            m_has_removed = true;
         }
+        return objects_count - removeMarkedObjects();
     }
 
-    void deleteSpawnersOfType(TYPE type) {
-        for (uint64_t i{ 0 }; i < m_objects.size(); i++) {
-            VerletObject& obj = m_objects[i];
+    template<typename TPredicate>
+    uint64_t removeSpawnersIf(TPredicate&& predicate)
+    {
+        const uint64_t spawners_count = m_spawners.size();
+        m_spawners.erase(std::remove_if(m_spawners.begin(), m_spawners.end(), predicate), m_spawners.end());
+        return spawners_count - m_spawners.size();
+    }
 
-            if (obj.spawnerType == type && obj.type == SPAWNER) {
-                m_objects.erase(m_objects.begin() + i--);
+    void deleteBrush(float radius) {
+        deleteBrush(radius, getCurrentMousePosF());
+    }
 
+    // Runs every frame while held, so only the chunks under the brush are visited
+    void deleteBrush(float radius, sf::Vector2f pos) {
+        const float radius_sq = radius * radius;
+        queryChunks(pos, radius, [&](VerletObject& obj) {
+            const sf::Vector2f v = pos - obj.position;
+            if (!obj.removed && v.x * v.x + v.y * v.y < radius_sq) {
+                markRemoved(obj);
             }
-        }
+        });
+        removeMarkedObjects();
+
+        deleteSpawnersInRadius(radius, pos);
     }
 
-    void clearHalf() {
-        for (uint64_t i{ 0 }; i < m_objects.size(); i++) {
-            if (m_objects[i].type == SPAWNER || m_objects[i].type == CONCRETE) {
-                continue;
-            }
+    void deleteSpawnersInRadius(float radius, sf::Vector2f pos) {
+        removeSpawnersIf([&](const Spawner& spawner) {
+            return getVectorMagnitude(pos - spawner.position) < radius;
+        });
+    }
 
-            int randNum = rand() % 2;
-            if (randNum == 0) {
-                m_objects.erase(m_objects.begin() + i--);
-            }
+    void deleteObjectsOfType(TYPE type) {
+        if (type == SPAWNER) {
+            m_spawners.clear();
+            return;
+        }
+
+        if (type == GAS) {
+            removeIf([](const VerletObject& obj) { return obj.type == FIRE_GAS || obj.type == GAS; }, true);
+            return;
         }
+
+        removeIf([type](const VerletObject& obj) { return obj.type == type; }, true);
+    }
+
+    void deleteSpawnersOfType(TYPE type) {
+        removeSpawnersIf([type](const Spawner& spawner) { return spawner.spawnerType == type; });
+    }
+
+    void clearHalf() {
+        // The generator is not thread safe, kept sequential
+        removeIf([this](const VerletObject& obj) {
+            return obj.type != CONCRETE && getRandom() % 2 == 0;
+        });
     }
 
     void clearAll() {
+        m_removed_total += m_objects.size();
         m_objects.clear();
+        m_spawners.clear();
         m_links.clear();
+        m_handle_slots.clear();
+        m_free_handles.clear();
+        m_timers.clear();
+        m_active.clear();
+        m_border.clear();
+        m_new_objects.clear();
+        m_chunks_valid = false;
+        m_stats.type_counts.fill(0);
     }
 
     void deleteBack() {
-        m_objects.erase(m_objects.begin() + getObjectsCount() - 1);
+        removeObject(getObjectsCount() - 1);
     }
 
     float getVectorMagnitudeSqr(sf::Vector2f vec) {
@@ -550,6 +1087,7 @@ public:
     }
 
     bool readSave(std::string fileName) {
+        TraceScope trace{ "Read save" };
         std::ifstream file(fileName);
 
         if (!file.is_open()) {
@@ -583,17 +1121,23 @@ public:
             std::getline(file, line);
             int spawnerType = std::stoi(line);
 
+            if (type == SPAWNER) {
+                addSpawner({ x,y }, (TYPE)spawnerType, counter, bounce, friction);
+                continue;
+            }
+
+            // Bounce and friction of objects come from their material
             VerletObject& obj = addObject({ x,y }, (TYPE)type);
-            obj.spawnerType = (TYPE)spawnerType;
             obj.counter = counter;
-            obj.bounce = bounce;
-            obj.frictionCoeff = friction;
         }
 
         file.close();
+
+        return true;
     }
 
     bool writeSave(std::string fileName) {
+        TraceScope trace{ "Write save" };
         std::ofstream file(fileName);
         
         if (!file) {
@@ -604,10 +1148,18 @@ public:
         for (VerletObject& obj : m_objects) {
             ss << obj.position.x << "," << obj.position.y << ",";
             ss << obj.counter << ",";
-            ss << obj.bounce << ",";
-            ss << obj.frictionCoeff << ",";
+            ss << obj.getBounce() << ",";
+            ss << obj.getFriction() << ",";
             ss << (int)obj.type << ",";
-            ss << (int)obj.spawnerType << "\n";
+            ss << (int)NONE << "\n";
+        }
+        for (const Spawner& spawner : m_spawners) {
+            ss << spawner.position.x << "," << spawner.position.y << ",";
+            ss << spawner.delay << ",";
+            ss << spawner.radius << ",";
+            ss << spawner.power << ",";
+            ss << (int)SPAWNER << ",";
+            ss << (int)spawner.spawnerType << "\n";
         }
         file << ss.str();
         file.close();
@@ -617,72 +1169,594 @@ public:
 
 private:
     uint32_t                  m_sub_steps          = 1;
+    bool                      m_adaptive_sub_steps = false;
+    uint32_t                  m_min_sub_steps      = 1;
+    uint32_t                  m_max_sub_steps      = 8;
+    uint32_t                  m_sub_steps_surplus  = 0;
+    float                     m_max_overlap        = 0.0f;
+    float                     m_last_max_overlap   = 0.0f;
+    SolverStats               m_stats;
+    // Running totals, the stats report the difference since the previous update
+    uint64_t                  m_spawned_total      = 0;
+    uint64_t                  m_removed_total      = 0;
+    uint64_t                  m_spawned_reported   = 0;
+    uint64_t                  m_removed_reported   = 0;
+
+    // Per step motion and per frame overlap growth limits, in radii
+    static constexpr float    target_step_motion   = 1.0f;
+    static constexpr float    max_overlap_growth   = 0.75f;
+    // Frames in a row with too many sub steps before dropping one, growing is immediate
+    static constexpr uint32_t sub_steps_drop_frames = 15;
+    // Share of the motion target the fastest object has to stay under with one step less
+    static constexpr float    sub_steps_drop_motion = 0.75f;
     sf::Vector2f              m_gravity            = {0.0f, 1000.0f};
+    ConstraintShape           m_constraint_shape   = ConstraintShape::Box;
+    sf::Vector2f              m_world_min          = {50.0f, 50.0f};
+    sf::Vector2f              m_world_max          = {1450.0f, 950.0f};
     sf::Vector2f              m_constraint_center;
     float                     m_constraint_radius  = 100.0f;
+    std::vector<uint8_t>      m_boundary_contacts;
+
+    static constexpr uint8_t  floor_contact        = 1;
+    static constexpr uint8_t  ceiling_contact      = 2;
     
     float                     m_time               = 0.0f;
     float                     m_frame_dt           = 0.0f;
     
     unsigned int              m_frame_num          = 0;
 
-    void applyGravity()
+    // Owned by the instance so that solvers stepped on different threads share nothing
+    std::minstd_rand          m_rng;
+    sf::Vector2i              m_mouse_pos;
+    sf::Vector2i              m_last_mouse_pos;
+
+    struct HandleSlot
     {
-        for (auto& obj : m_objects) {
-            if (!obj.pinned) {
-                switch (obj.type)
-                {
-                case GAS:
-                    obj.accelerate(-m_gravity * obj.mass);
-                    break;
-                case FIRE_GAS:
-                    obj.accelerate(-m_gravity * obj.mass);
-                    break;
-                default:
-                    obj.accelerate(m_gravity * obj.mass);
-                    break;
+        uint64_t index;
+        uint32_t generation;
+    };
+
+    std::vector<HandleSlot>   m_handle_slots;
+    std::vector<uint32_t>     m_free_handles;
+    TimerWheel<ObjectTimer>   m_timers;
+
+    std::vector<Spawner>      m_spawners;
+
+    // The world is cut in fixed size chunks owning the handles of the objects inside them.
+    // Only the objects of awake chunks are simulated, the sleeping ones next to them are collision obstacles.
+    struct Chunk
+    {
+        std::vector<ObjectHandle> objects;
+        float                     max_motion   = 0.0f;
+        float                     total_motion = 0.0f;
+        uint32_t                  quiet_frames = 0;
+        bool                      awake        = true;
+        // Its objects are in m_active, so its list is rebuilt every frame
+        bool                      simulated    = false;
+    };
+
+    std::vector<Chunk>        m_chunks;
+    sf::Vector2f              m_chunks_origin;
+    int32_t                   m_chunks_width       = 0;
+    int32_t                   m_chunks_height      = 0;
+    bool                      m_chunks_valid       = false;
+    bool                      m_chunk_sleeping     = false;
+
+    std::vector<uint32_t>     m_active;
+    std::vector<ObjectHandle> m_border;
+    std::vector<ObjectHandle> m_new_objects;
+    std::vector<uint32_t>     m_colliders;
+    SpatialGrid               m_collision_grid;
+    bool                      m_has_removed        = false;
+    uint64_t                  m_first_removed      = 0;
+    std::vector<uint32_t>     m_index_remap;
+
+    struct FluidParticle
+    {
+        sf::Vector2f position;
+        // Radius of the kernel
+        float        kernel;
+        float        lambda;
+        TYPE         type;
+    };
+
+    bool                       m_position_based_fluids = false;
+    // Liquid objects, simulated ones first, then the sleeping ones around them
+    std::vector<uint32_t>      m_fluid_objects;
+    std::vector<FluidParticle> m_fluid_particles;
+    // Neighbours of m_fluid_objects[k] as positions in it, from m_fluid_neighbours_start[k] to [k + 1]
+    std::vector<uint32_t>      m_fluid_neighbours_start;
+    std::vector<uint32_t>      m_fluid_neighbours;
+    // Kernel gradient of every neighbour pair, pointing away from the neighbour
+    std::vector<sf::Vector2f>  m_fluid_gradients;
+    std::vector<sf::Vector2f>  m_fluid_corrections;
+    SpatialGrid                m_fluid_grid;
+
+    static constexpr float    chunk_size           = 256.0f;
+    static constexpr float    chunk_query_margin   = 32.0f;
+    static constexpr uint32_t chunk_sleep_frames   = 60;
+    // Per step displacements under which a chunk is considered at rest. Piles never fully settle,
+    // so the average is tested while the maximum only catches objects actually flying through
+    static constexpr float    chunk_sleep_motion   = 0.1f;
+    static constexpr float    chunk_max_motion     = 0.5f;
+    static constexpr uint32_t invalid_index        = 0xFFFFFFFF;
+
+    static constexpr float    grid_cell_size       = 32.0f;
+
+    // Kernel radius of the density constraint, in radii of the liquid particle
+    static constexpr float    fluid_kernel_scale   = 3.0f;
+    // Softens the constraint, higher is more compressible but steadier
+    static constexpr float    fluid_relaxation     = 1.0f;
+    // Part of the correction applied per iteration, neighbours correct the same overlap from both sides
+    static constexpr float    fluid_stiffness      = 0.5f;
+    static constexpr uint32_t fluid_iterations     = 2;
+    // Fewer steps compress the liquid so much per step that it bounces back
+    static constexpr uint32_t fluid_min_sub_steps  = 3;
+
+    static constexpr float    touch_radius         = 150.0f;
+    static constexpr uint32_t max_touch_points     = 50;
+
+    struct TouchContact
+    {
+        sf::Vector2f position;
+        bool         active = false;
+    };
+
+    std::array<TouchContact, max_touch_points> m_touch_contacts;
+    std::vector<TouchPoint>                    m_touch_points;
+
+    static constexpr uint32_t lifespan_tick_frames = 300;
+    // Timers only follow the frame count, whatever the sub step count is. These keep the rates lifespans
+    // and emissions were tuned with, when they ran once per sub step at 4 sub steps.
+    static constexpr uint32_t lifespan_tick_units  = 4;
+    static constexpr uint32_t emission_rolls       = 4;
+    // Below this removeIf does not bother spreading the predicate over threads
+    static constexpr uint64_t parallel_remove_min_objects = 65536;
+
+    template<typename TCallback>
+    void timePhase(SolverPhase phase, TCallback&& callback)
+    {
+        TraceScope trace{ solverPhaseString[static_cast<uint32_t>(phase)] };
+        const auto start = std::chrono::steady_clock::now();
+        callback();
+        m_stats.phase_ms[static_cast<uint32_t>(phase)] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Room for `count` more elements, grown geometrically so repeated bulk spawns stay amortised
+    template<typename T>
+    static void reserveFor(std::vector<T>& vector, uint64_t count)
+    {
+        const uint64_t required = vector.size() + count;
+        if (required > vector.capacity()) {
+            vector.reserve(std::max<uint64_t>(required, vector.capacity() * 2));
+        }
+    }
+
+    template<typename T>
+    static uint64_t getCapacityBytes(const std::vector<T>& vector)
+    {
+        return vector.capacity() * sizeof(T);
+    }
+
+    uint32_t allocateHandle(uint64_t index)
+    {
+        if (!m_free_handles.empty()) {
+            const uint32_t id = m_free_handles.back();
+            m_free_handles.pop_back();
+            m_handle_slots[id].index = index;
+            return id;
+        }
+        m_handle_slots.push_back({index, 0});
+        return static_cast<uint32_t>(m_handle_slots.size() - 1);
+    }
+
+    void releaseObject(const VerletObject& obj)
+    {
+        HandleSlot& slot = m_handle_slots[obj.handle];
+        // Pending timers and chunk entries of this object become stale
+        slot.generation++;
+        m_free_handles.push_back(obj.handle);
+        // Whatever rested on it has to fall again
+        wakeRegion(obj.position, obj.radius * 2.0f);
+    }
+
+    void removeObject(uint64_t index)
+    {
+        markRemoved(m_objects[index]);
+        removeMarkedObjects();
+    }
+
+    // Removal during a pass only flags the object, the storage is compacted once afterward
+    void markRemoved(VerletObject& obj)
+    {
+        const uint64_t index = m_handle_slots[obj.handle].index;
+        m_first_removed = m_has_removed ? std::min(m_first_removed, index) : index;
+        m_has_removed = true;
+        obj.removed = true;
+    }
+
+    // Returns the number of objects left
+    uint64_t removeMarkedObjects()
+    {
+        if (!m_has_removed) {
+            return m_objects.size();
+        }
+        m_has_removed = false;
+        TraceScope trace{ "Compact objects" };
+
+        const uint64_t objects_count = m_objects.size();
+        m_index_remap.resize(objects_count);
+        uint64_t write = m_first_removed;
+        for (uint64_t i{ m_first_removed }; i < objects_count; i++) {
+            if (m_objects[i].removed) {
+                releaseObject(m_objects[i]);
+                m_stats.type_counts[m_objects[i].type]--;
+                m_removed_total++;
+                m_index_remap[i] = invalid_index;
+                continue;
+            }
+            m_objects[write] = m_objects[i];
+            m_handle_slots[m_objects[write].handle].index = write;
+            m_index_remap[i] = static_cast<uint32_t>(write++);
+        }
+        m_objects.resize(write);
+
+        uint64_t active_write = 0;
+        for (const uint32_t i : m_active) {
+            const uint32_t new_index = i < m_first_removed ? i : m_index_remap[i];
+            if (new_index != invalid_index) {
+                m_active[active_write++] = new_index;
+            }
+        }
+        m_active.resize(active_write);
+
+        // Links to a removed object go with it
+        const auto remap = [&](int index) {
+            if (index < 0 || static_cast<uint64_t>(index) >= objects_count) {
+                return invalid_index;
+            }
+            return static_cast<uint64_t>(index) < m_first_removed ? static_cast<uint32_t>(index) : m_index_remap[index];
+        };
+        uint64_t link_write = 0;
+        for (const Link& link : m_links) {
+            const uint32_t obj_1 = remap(link.obj_1);
+            const uint32_t obj_2 = remap(link.obj_2);
+            if (obj_1 != invalid_index && obj_2 != invalid_index) {
+                m_links[link_write++] = { static_cast<int>(obj_1), static_cast<int>(obj_2), link.target_dist };
+            }
+        }
+        m_links.resize(link_write);
+
+        return write;
+    }
+
+    void rebuildChunks()
+    {
+        sf::Vector2f min = m_world_min;
+        sf::Vector2f max = m_world_max;
+        if (m_constraint_shape == ConstraintShape::Circle) {
+            min = m_constraint_center - sf::Vector2f{ m_constraint_radius, m_constraint_radius };
+            max = m_constraint_center + sf::Vector2f{ m_constraint_radius, m_constraint_radius };
+        }
+
+        m_chunks_origin = min;
+        m_chunks_width  = std::max(1, static_cast<int32_t>(std::ceil((max.x - min.x) / chunk_size)));
+        m_chunks_height = std::max(1, static_cast<int32_t>(std::ceil((max.y - min.y) / chunk_size)));
+        m_chunks.assign(static_cast<uint64_t>(m_chunks_width) * m_chunks_height, {});
+        m_chunks_valid = true;
+
+        m_active.clear();
+        m_border.clear();
+        m_new_objects.clear();
+        for (VerletObject& obj : m_objects) {
+            binObject(obj);
+        }
+    }
+
+    int32_t getChunkCoord(float offset, int32_t size) const
+    {
+        // Objects outside of the world belong to the border chunks
+        const float coord = std::max(0.0f, offset / chunk_size);
+        return static_cast<int32_t>(std::min(coord, static_cast<float>(size - 1)));
+    }
+
+    uint32_t getChunkIndex(sf::Vector2f position) const
+    {
+        const int32_t x = getChunkCoord(position.x - m_chunks_origin.x, m_chunks_width);
+        const int32_t y = getChunkCoord(position.y - m_chunks_origin.y, m_chunks_height);
+        return static_cast<uint32_t>(y * m_chunks_width + x);
+    }
+
+    template<typename TCallback>
+    void forEachChunk(sf::Vector2f center, float radius, TCallback&& callback) const
+    {
+        const int32_t min_x = getChunkCoord(center.x - radius - m_chunks_origin.x, m_chunks_width);
+        const int32_t max_x = getChunkCoord(center.x + radius - m_chunks_origin.x, m_chunks_width);
+        const int32_t min_y = getChunkCoord(center.y - radius - m_chunks_origin.y, m_chunks_height);
+        const int32_t max_y = getChunkCoord(center.y + radius - m_chunks_origin.y, m_chunks_height);
+
+        for (int32_t y{ min_y }; y <= max_y; y++) {
+            for (int32_t x{ min_x }; x <= max_x; x++) {
+                callback(static_cast<uint32_t>(y * m_chunks_width + x));
+            }
+        }
+    }
+
+    // Calls callback(object) for every object of the chunks overlapping the query square.
+    // Chunk lists are refreshed once per frame, the margin catches objects that crossed a border since.
+    // Callers still have to test the exact distance.
+    template<typename TCallback>
+    void queryChunks(sf::Vector2f center, float radius, TCallback&& callback)
+    {
+        if (!m_chunks_valid) {
+            rebuildChunks();
+        }
+        forEachChunk(center, radius + chunk_query_margin, [&](uint32_t c) {
+            for (const ObjectHandle handle : m_chunks[c].objects) {
+                if (VerletObject* obj = getObject(handle)) {
+                    callback(*obj);
                 }
             }
+        });
+        // Objects added since the last update are in no chunk yet
+        for (const ObjectHandle handle : m_new_objects) {
+            if (VerletObject* obj = getObject(handle)) {
+                callback(*obj);
+            }
         }
     }
 
-    void applyTouchForce(float power)
+    void wakeChunk(uint32_t c)
     {
-        for (auto& obj : m_objects) {
-            if (!obj.pinned) {
-                for (int i = 0; i < MAXPOINTS; i++) {
-                    if (points[i][0] >= 0) {
-                        sf::Vector2f touchPoint = {(float) points[i][0], (float) points[i][1] };
-                        sf::Vector2f v = obj.position - touchPoint;
-                        float dist2 = v.x * v.x + v.y * v.y;
-                        float dist = sqrt(dist2);
-                        if (dist < 150) {
-                            obj.accelerate({ (power * 0.5f) * diff_points[i][0], (power * 0.5f) * diff_points[i][1] });
-                        }
+        m_chunks[c].awake        = true;
+        m_chunks[c].quiet_frames = 0;
+    }
+
+    void wakeRegion(sf::Vector2f center, float radius)
+    {
+        // Everything is awake after a rebuild anyway
+        if (!m_chunks_valid) {
+            return;
+        }
+        forEachChunk(center, radius, [this](uint32_t c) { wakeChunk(c); });
+    }
+
+    void binObject(VerletObject& obj)
+    {
+        const uint32_t c = getChunkIndex(obj.position);
+        Chunk& chunk = m_chunks[c];
+        obj.chunk = c;
+        chunk.objects.push_back(getHandle(obj));
+        const float motion = getVectorMagnitude(obj.position - obj.position_last);
+        chunk.max_motion    = std::max(chunk.max_motion, motion);
+        chunk.total_motion += motion;
+        // Moved into a sleeping chunk or just created
+        if (!chunk.simulated) {
+            wakeChunk(c);
+        }
+    }
+
+    bool hasAwakeNeighbour(int32_t x, int32_t y) const
+    {
+        for (int32_t ny{ std::max(0, y - 1) }; ny <= std::min(m_chunks_height - 1, y + 1); ny++) {
+            for (int32_t nx{ std::max(0, x - 1) }; nx <= std::min(m_chunks_width - 1, x + 1); nx++) {
+                if (m_chunks[ny * m_chunks_width + nx].awake) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Once per frame: moves simulated objects to their current chunk, puts quiet chunks to sleep
+    // and rebuilds the list of objects to simulate. Sleeping chunks are never visited by the passes.
+    void updateChunks()
+    {
+        if (!m_chunks_valid) {
+            rebuildChunks();
+        }
+
+        // Objects of sleeping chunks have not moved, only the simulated ones need to be binned again
+        for (Chunk& chunk : m_chunks) {
+            if (chunk.simulated) {
+                chunk.objects.clear();
+                chunk.max_motion   = 0.0f;
+                chunk.total_motion = 0.0f;
+            }
+        }
+        for (const uint32_t i : m_active) {
+            binObject(m_objects[i]);
+        }
+        for (const ObjectHandle handle : m_new_objects) {
+            if (VerletObject* obj = getObject(handle)) {
+                binObject(*obj);
+            }
+        }
+        m_new_objects.clear();
+
+        // Spawners, fingers and links keep their surroundings awake
+        for (const Spawner& spawner : m_spawners) {
+            const float reach = spawner.spawnerType == BLACKHOLE ? spawner.radius * 5.0f
+                              : spawner.spawnerType == NONE      ? spawner.radius
+                              : 0.0f;
+            wakeRegion(spawner.position, reach);
+        }
+        for (const TouchPoint& touch : m_touch_points) {
+            wakeRegion(touch.position, touch_radius);
+        }
+        for (const Link& link : m_links) {
+            const uint32_t chunk_1 = m_objects[link.obj_1].chunk;
+            const uint32_t chunk_2 = m_objects[link.obj_2].chunk;
+            if (m_chunks[chunk_1].awake || m_chunks[chunk_2].awake) {
+                wakeChunk(chunk_1);
+                wakeChunk(chunk_2);
+            }
+        }
+
+        for (Chunk& chunk : m_chunks) {
+            if (!chunk.awake || !chunk.simulated) {
+                continue;
+            }
+
+            const bool quiet = chunk.max_motion < chunk_max_motion
+                            && chunk.total_motion <= chunk_sleep_motion * static_cast<float>(chunk.objects.size());
+            chunk.quiet_frames = quiet ? chunk.quiet_frames + 1 : 0;
+            if (m_chunk_sleeping && chunk.quiet_frames >= chunk_sleep_frames) {
+                chunk.awake = false;
+                // Leftover velocity would be applied all at once on wake up
+                for (const ObjectHandle handle : chunk.objects) {
+                    if (VerletObject* obj = getObject(handle)) {
+                        obj->position_last          = obj->position;
+                        obj->position_before_update = obj->position;
+                        obj->acceleration           = {};
                     }
                 }
             }
         }
+
+        m_active.clear();
+        m_border.clear();
+        for (int32_t y{ 0 }; y < m_chunks_height; y++) {
+            for (int32_t x{ 0 }; x < m_chunks_width; x++) {
+                Chunk& chunk = m_chunks[y * m_chunks_width + x];
+                chunk.simulated = chunk.awake;
+                if (!chunk.awake && !hasAwakeNeighbour(x, y)) {
+                    continue;
+                }
+
+                // Drop the entries of objects deleted while the chunk was sleeping
+                chunk.objects.erase(std::remove_if(chunk.objects.begin(), chunk.objects.end(),
+                                    [this](ObjectHandle handle) { return !getObject(handle); }), chunk.objects.end());
+                for (const ObjectHandle handle : chunk.objects) {
+                    if (chunk.awake) {
+                        // Only simulated objects move, sleeping ones keep the snapshot taken when they fell asleep
+                        const uint64_t index = m_handle_slots[handle.id].index;
+                        m_objects[index].position_before_update = m_objects[index].position;
+                        m_active.push_back(static_cast<uint32_t>(index));
+                    }
+                    else {
+                        m_border.push_back(handle);
+                    }
+                }
+            }
+        }
+
+        m_stats.active_objects = m_active.size();
+        m_stats.awake_chunks   = getAwakeChunksCount();
+    }
+
+    // Enough sub steps for the fastest object to move less than its radius per step
+    // and for the deepest overlap not to jump from one frame to the next
+    void updateSubSteps()
+    {
+        float max_step_motion = 0.0f;
+        for (const uint32_t i : m_active) {
+            const VerletObject& obj = m_objects[i];
+            // Gas and fire live a few ticks and drift through everything, they do not need smaller steps
+            if (!obj.pinned && materials[obj.type].lifespan < 0) {
+                max_step_motion = std::max(max_step_motion, getVectorMagnitude(obj.position - obj.position_last) / obj.radius);
+            }
+        }
+        m_stats.max_motion  = max_step_motion * static_cast<float>(m_sub_steps);
+        m_stats.max_overlap = m_max_overlap;
+        const float overlap_growth = m_max_overlap - m_last_max_overlap;
+        m_last_max_overlap = m_max_overlap;
+
+        if (m_adaptive_sub_steps) {
+            const uint32_t wanted_motion = static_cast<uint32_t>(std::min(std::ceil(m_stats.max_motion / target_step_motion),
+                                                                          static_cast<float>(m_max_sub_steps)));
+            // Liquid overlaps no longer count, the density solve sets its own floor instead
+            const uint32_t min_sub_steps = m_position_based_fluids ? std::min(std::max(m_min_sub_steps, fluid_min_sub_steps), m_max_sub_steps)
+                                                                   : m_min_sub_steps;
+            uint32_t sub_steps = std::max(min_sub_steps, std::min(wanted_motion, m_max_sub_steps));
+
+            // Overlaps depend on the whole stack, so they only nudge the count one step at a time.
+            // A resting pile keeps a steady overlap whatever the count, only a sudden increase is an impact.
+            if (overlap_growth > max_overlap_growth) {
+                sub_steps = std::max(sub_steps, std::min(m_sub_steps + 1, m_max_sub_steps));
+            }
+            // One step less has to leave a margin under the limits, a pile right on them jitters back up
+            else if (sub_steps < m_sub_steps && (overlap_growth > max_overlap_growth * 0.5f
+                     || m_stats.max_motion > target_step_motion * sub_steps_drop_motion * static_cast<float>(m_sub_steps - 1))) {
+                sub_steps = m_sub_steps;
+            }
+
+            if (sub_steps < m_sub_steps) {
+                // Dropping a step can bring fast objects or overlaps back, so only do it after a calm stretch
+                sub_steps = ++m_sub_steps_surplus >= sub_steps_drop_frames ? m_sub_steps - 1 : m_sub_steps;
+            }
+            else {
+                m_sub_steps_surplus = 0;
+            }
+            if (sub_steps != m_sub_steps) {
+                m_sub_steps_surplus = 0;
+                rescaleVelocities(m_sub_steps, sub_steps);
+                m_sub_steps = sub_steps;
+            }
+        }
+        m_stats.sub_steps = m_sub_steps;
+    }
+
+    // Velocities are implicit in Verlet, the last positions have to follow a change of step size
+    void rescaleVelocities(uint32_t old_sub_steps, uint32_t new_sub_steps)
+    {
+        const float ratio = static_cast<float>(old_sub_steps) / static_cast<float>(new_sub_steps);
+        for (const uint32_t i : m_active) {
+            VerletObject& obj = m_objects[i];
+            obj.position_last = obj.position - (obj.position - obj.position_last) * ratio;
+        }
+    }
+
+    void applyGravity()
+    {
+        for (const uint32_t i : m_active) {
+            VerletObject& obj = m_objects[i];
+            if (!obj.pinned) {
+                obj.accelerate(m_gravity * (materials[obj.type].gravity * obj.mass));
+            }
+        }
     }
 
     void checkCollisions(float dt)
     {
         const float    response_coef = 0.75f;
-        //const uint64_t objects_count = m_objects.size();
-        // Iterate on all objects
-        for (uint64_t i{ 0 }; i < m_objects.size(); i++) {
-            VerletObject& object_1 = m_objects[i];
-            // Iterate on object involved in new collision pairs
 
-            if (object_1.type == SPAWNER) {
-                continue;
+        // Simulated objects first, then the sleeping ones around them which only take part as obstacles
+        m_colliders.assign(m_active.begin(), m_active.end());
+        const uint64_t active_count = m_colliders.size();
+        for (const ObjectHandle handle : m_border) {
+            if (getObject(handle)) {
+                m_colliders.push_back(static_cast<uint32_t>(m_handle_slots[handle.id].index));
             }
+        }
 
-            for (uint64_t k{i + 1}; k < m_objects.size(); k++) {
-                VerletObject&      object_2 = m_objects[k];
+        float max_radius = 0.0f;
+        for (const uint32_t i : m_colliders) {
+            max_radius = std::max(max_radius, m_objects[i].radius);
+        }
+        m_collision_grid.build(m_objects, m_colliders, grid_cell_size);
 
-                if (object_2.type == SPAWNER) {
-                    continue;
+        // Iterate on all simulated objects
+        for (uint64_t a{ 0 }; a < active_count; a++) {
+            const uint32_t i = m_colliders[a];
+            if (m_objects[i].removed) {
+                continue;
+            }
+
+            // Iterate on object involved in new collision pairs
+            m_collision_grid.query(m_objects[i].position, m_objects[i].radius + max_radius, [&](uint32_t b) {
+                if (b <= a) {
+                    return;
+                }
+                // Reactions may add objects and reallocate the storage, take the references again
+                VerletObject&      object_1 = m_objects[i];
+                VerletObject&      object_2 = m_objects[m_colliders[b]];
+                if (object_1.removed || object_2.removed) {
+                    return;
+                }
+                // Left to the density constraint
+                if (m_position_based_fluids && object_1.type == object_2.type && isLiquid(object_1.type)) {
+                    return;
                 }
 
                 const sf::Vector2f v        = object_1.position - object_2.position;
@@ -690,6 +1764,7 @@ private:
                 const float        min_dist = object_1.radius + object_2.radius;
                 // Check overlapping
                 if (dist2 < min_dist * min_dist) {
+                    m_stats.collision_pairs++;
                     const float        dist  = sqrt(dist2);
                     const sf::Vector2f n     = v / dist;
                     /*const float mass_ratio_1 = object_1.radius / (object_1.radius + object_2.radius);
@@ -699,29 +1774,217 @@ private:
                     const float delta        = 0.5f * response_coef * (dist - min_dist);
                     // Update positions
 
-                    bool canUpdate = computeReaction(object_1, object_2, mass_ratio_1, mass_ratio_2, i ,k);
-
-                    if (!canUpdate) {
-                        continue;
+                    if (!computeReaction(object_1, object_2, mass_ratio_1, mass_ratio_2)) {
+                        return;
+                    }
+                    // Objects spawned on top of each other and fluids seeping through other materials
+                    // are not a sign of too large steps, only count solid contacts closing in
+                    const sf::Vector2f approach = (object_1.position - object_1.position_last) - (object_2.position - object_2.position_last);
+                    const bool         solid    = object_1.type == object_2.type || (!object_1.isFluid && !object_2.isFluid);
+                    if (solid && approach.x * n.x + approach.y * n.y < 0.0f) {
+                        m_max_overlap = std::max(m_max_overlap, (min_dist - dist) / std::min(object_1.radius, object_2.radius));
                     }
 
                     if (!object_1.pinned)
                         object_1.position -= n * (mass_ratio_2 * delta);
-                    if (!object_2.pinned)
+                    if (!object_2.pinned) {
                         object_2.position += n * (mass_ratio_1 * delta);
+                        if (b >= active_count) {
+                            // Sleeping objects are not integrated, the push must not turn into velocity on wake up
+                            object_2.position_last += n * (mass_ratio_1 * delta);
+                            // Pushed hard enough, the sleeping chunk has to be simulated again
+                            if (-mass_ratio_1 * delta > chunk_sleep_motion) {
+                                wakeChunk(object_2.chunk);
+                            }
+                        }
+                    }
 
                     /*if (!object_1.isFluid && object_1.type != object_2.type)
                         object_1.setVelocity({ 0,0 }, getStepDt());
                     if (!object_2.isFluid && object_1.type != object_2.type)
                         object_2.setVelocity({ 0,0 }, getStepDt());*/
                 }
+            });
+        }
+
+        removeMarkedObjects();
+    }
+
+    // Position based fluids (Macklin and Mueller 2013), a few Jacobi iterations per sub step.
+    // Every liquid object gets a density constraint from its neighbours of the same type, positions are then moved
+    // along the constraint gradients. Only compression is corrected, so surfaces do not clump without a tensile term.
+    // The kernel is (1 - d / h)³, its gradient does not vanish up close so particles cannot pile on each other.
+    void solveFluids()
+    {
+        m_fluid_objects.clear();
+        for (const uint32_t i : m_active) {
+            if (isLiquid(m_objects[i].type)) {
+                m_fluid_objects.push_back(i);
+            }
+        }
+        const uint64_t active_count = m_fluid_objects.size();
+        if (!active_count) {
+            return;
+        }
+        // Sleeping liquid around the simulated one still has a density, it just does not move
+        for (const ObjectHandle handle : m_border) {
+            const VerletObject* obj = getObject(handle);
+            if (obj && isLiquid(obj->type)) {
+                m_fluid_objects.push_back(static_cast<uint32_t>(m_handle_slots[handle.id].index));
+            }
+        }
+
+        // The iterations run on a compact copy, the objects are too large to stream through several times
+        const uint64_t fluids_count = m_fluid_objects.size();
+        float          max_kernel   = 0.0f;
+        m_fluid_particles.resize(fluids_count);
+        for (uint64_t k{ 0 }; k < fluids_count; k++) {
+            const VerletObject& obj = m_objects[m_fluid_objects[k]];
+            m_fluid_particles[k] = { obj.position, obj.radius * fluid_kernel_scale, 0.0f, obj.type };
+            max_kernel = std::max(max_kernel, m_fluid_particles[k].kernel);
+        }
+
+        // Neighbours are gathered once, objects move much less than the kernel radius over the iterations
+        m_fluid_grid.build(m_fluid_particles, max_kernel);
+        m_fluid_neighbours_start.resize(fluids_count + 1);
+        m_fluid_neighbours.clear();
+        for (uint64_t k{ 0 }; k < fluids_count; k++) {
+            m_fluid_neighbours_start[k] = static_cast<uint32_t>(m_fluid_neighbours.size());
+            const FluidParticle& particle = m_fluid_particles[k];
+            const float          h        = particle.kernel;
+            m_fluid_grid.query(particle.position, h, [&](uint32_t n) {
+                const FluidParticle& other = m_fluid_particles[n];
+                const sf::Vector2f   v     = particle.position - other.position;
+                if (n != k && other.type == particle.type && v.x * v.x + v.y * v.y < h * h) {
+                    m_fluid_neighbours.push_back(n);
+                }
+            });
+        }
+        m_fluid_neighbours_start[fluids_count] = static_cast<uint32_t>(m_fluid_neighbours.size());
+
+        const float rest_density = getFluidRestDensity();
+        m_fluid_gradients.resize(m_fluid_neighbours.size());
+        m_fluid_corrections.resize(active_count);
+        for (uint32_t iteration{ 0 }; iteration < fluid_iterations; iteration++) {
+            for (uint64_t k{ 0 }; k < fluids_count; k++) {
+                FluidParticle& particle      = m_fluid_particles[k];
+                const float    h             = particle.kernel;
+                float          density       = 1.0f;
+                sf::Vector2f   gradient      = {};
+                float          gradients_sum = 0.0f;
+                for (uint32_t e{ m_fluid_neighbours_start[k] }; e < m_fluid_neighbours_start[k + 1]; e++) {
+                    const sf::Vector2f v     = particle.position - m_fluid_particles[m_fluid_neighbours[e]].position;
+                    const float        dist2 = v.x * v.x + v.y * v.y;
+                    m_fluid_gradients[e] = {};
+                    if (dist2 < h * h && dist2 > 0.0f) {
+                        const float dist = std::sqrt(dist2);
+                        const float w    = 1.0f - dist / h;
+                        const float g    = 3.0f * w * w / h;
+                        density       += w * w * w;
+                        // Kept for the corrections, positions do not change in between
+                        m_fluid_gradients[e] = v * (g / dist);
+                        gradient      += m_fluid_gradients[e];
+                        gradients_sum += g * g;
+                    }
+                }
+                const float constraint = density / rest_density - 1.0f;
+                particle.lambda = constraint > 0.0f
+                                ? -constraint * rest_density * rest_density
+                                  / (gradient.x * gradient.x + gradient.y * gradient.y + gradients_sum + fluid_relaxation / (h * h))
+                                : 0.0f;
+            }
+
+            // Corrections are gathered first so that every object sees the same positions
+            const float scale = fluid_stiffness / rest_density;
+            for (uint64_t k{ 0 }; k < active_count; k++) {
+                const float   lambda     = m_fluid_particles[k].lambda;
+                sf::Vector2f& correction = m_fluid_corrections[k];
+                correction = {};
+                for (uint32_t e{ m_fluid_neighbours_start[k] }; e < m_fluid_neighbours_start[k + 1]; e++) {
+                    correction -= m_fluid_gradients[e] * ((lambda + m_fluid_particles[m_fluid_neighbours[e]].lambda) * scale);
+                }
+            }
+            for (uint64_t k{ 0 }; k < active_count; k++) {
+                if (!m_objects[m_fluid_objects[k]].pinned) {
+                    m_fluid_particles[k].position += m_fluid_corrections[k];
+                }
+            }
+        }
+
+        for (uint64_t k{ 0 }; k < active_count; k++) {
+            m_objects[m_fluid_objects[k]].position = m_fluid_particles[k].position;
+        }
+
+        // Lava is slowed by its friction in collisions, here it turns into viscosity (XSPH)
+        for (uint64_t k{ 0 }; k < active_count; k++) {
+            const VerletObject& obj          = m_objects[m_fluid_objects[k]];
+            const float         viscosity    = 1.0f - obj.getFriction();
+            const sf::Vector2f  displacement = obj.position - obj.position_last;
+            sf::Vector2f&       correction   = m_fluid_corrections[k];
+            correction = {};
+            if (viscosity > 0.0f) {
+                forEachFluidNeighbour(k, [&](uint32_t n, float w) {
+                    const VerletObject& other = m_objects[m_fluid_objects[n]];
+                    correction += (other.position - other.position_last - displacement) * (viscosity * w * w * w / rest_density);
+                });
+            }
+        }
+        for (uint64_t k{ 0 }; k < active_count; k++) {
+            VerletObject& obj = m_objects[m_fluid_objects[k]];
+            if (!obj.pinned) {
+                obj.position_last -= m_fluid_corrections[k];
+            }
+        }
+    }
+
+    // callback(neighbour, 1 - distance / kernel radius) for the neighbours of m_fluid_particles[k] still within its kernel
+    template<typename TCallback>
+    void forEachFluidNeighbour(uint64_t k, TCallback&& callback) const
+    {
+        const FluidParticle& particle = m_fluid_particles[k];
+        const float          h        = particle.kernel;
+        for (uint32_t e{ m_fluid_neighbours_start[k] }; e < m_fluid_neighbours_start[k + 1]; e++) {
+            const uint32_t     n     = m_fluid_neighbours[e];
+            const sf::Vector2f v     = particle.position - m_fluid_particles[n].position;
+            const float        dist2 = v.x * v.x + v.y * v.y;
+            if (dist2 < h * h) {
+                callback(n, 1.0f - std::sqrt(dist2) / h);
             }
         }
     }
 
+    // Kernel sum of a particle in a hexagonal packing at contact, the density the constraint keeps.
+    // Independent of the radius since the kernel scales with it.
+    static float getFluidRestDensity()
+    {
+        static const float density = [] {
+            const int32_t range   = static_cast<int32_t>(fluid_kernel_scale) + 1;
+            float         density = 0.0f;
+            for (int32_t y{ -range }; y <= range; y++) {
+                for (int32_t x{ -range }; x <= range; x++) {
+                    const float px = 2.0f * x + (y % 2 ? 1.0f : 0.0f);
+                    const float py = std::sqrt(3.0f) * y;
+                    const float q  = std::sqrt(px * px + py * py) / fluid_kernel_scale;
+                    if (q < 1.0f) {
+                        density += (1.0f - q) * (1.0f - q) * (1.0f - q);
+                    }
+                }
+            }
+            return density;
+        }();
+        return density;
+    }
+
     void applyLinkConstraint(float dt)
     {
         for (auto& alink : m_links) {
+            // Sleeping objects are not integrated, moving them would build up velocity released on wake up
+            Chunk* chunk_1 = m_chunks_valid ? &m_chunks[m_objects[alink.obj_1].chunk] : nullptr;
+            Chunk* chunk_2 = m_chunks_valid ? &m_chunks[m_objects[alink.obj_2].chunk] : nullptr;
+            if (chunk_1 && !chunk_1->simulated && !chunk_2->simulated) {
+                continue;
+            }
+
             sf::Vector2 axis = m_objects[alink.obj_1].position - m_objects[alink.obj_2].position;
             float dist = std::sqrt(axis.x * axis.x + axis.y * axis.y);
             sf::Vector2 n = axis / dist;
@@ -730,244 +1993,262 @@ private:
                 m_objects[alink.obj_1].position += 0.5f * delta * n;
             if (!m_objects[alink.obj_2].pinned)
                 m_objects[alink.obj_2].position -= 0.5f * delta * n;
+
+            // A link pulling on a sleeping end wakes it
+            if (chunk_1 && (!chunk_1->simulated || !chunk_2->simulated)) {
+                wakeChunk(m_objects[alink.obj_1].chunk);
+                wakeChunk(m_objects[alink.obj_2].chunk);
+            }
         }
     }
 
     void applyConstraint(float dt)
     {
-        //for (auto& obj : m_objects) {
-        for (uint64_t i = 0; i < m_objects.size(); i++) {
-            auto& obj = m_objects[i];
-            /*const sf::Vector2f v    = m_constraint_center - obj.position;
-            const float        dist = sqrt(v.x * v.x + v.y * v.y);
-            if (dist > (m_constraint_radius - obj.radius)) {
-                const sf::Vector2f n = v / dist;
-                obj.position = m_constraint_center - n * (m_constraint_radius - obj.radius);
-            }*/
-
-            // box constrain
-            if (!obj.pinned) {
-                float bounce = obj.bounce;
-
-                sf::Vector2 v = obj.position - obj.position_last;
-                if (obj.position.x > (1450 - obj.radius)) {
-                    obj.position.x = 1450 - obj.radius;
-                    //obj.position_last.x = obj.position.x + v.x * bounce;
-                }
-                if (obj.position.x < (50 + obj.radius)) {
-                    obj.position.x = 50 + obj.radius;
-                    //obj.position_last.x = obj.position.x + v.x * bounce;
+        const uint64_t objects_count = m_active.size();
+        m_boundary_contacts.resize(objects_count);
+
+        // Clamp pass, kept branch free since it runs on every object
+        if (m_constraint_shape == ConstraintShape::Box) {
+            for (uint64_t i{ 0 }; i < objects_count; i++) {
+                VerletObject&      obj    = m_objects[m_active[i]];
+                const sf::Vector2f margin = { obj.radius, obj.radius };
+                const sf::Vector2f min    = m_world_min + margin;
+                const sf::Vector2f max    = m_world_max - margin;
+                const sf::Vector2f clamped = { std::max(min.x, std::min(obj.position.x, max.x)),
+                                               std::max(min.y, std::min(obj.position.y, max.y)) };
+                const uint8_t contact = (obj.position.y > max.y ? floor_contact : 0) | (obj.position.y < min.y ? ceiling_contact : 0);
+
+                obj.position           = obj.pinned ? obj.position : clamped;
+                m_boundary_contacts[i] = obj.pinned ? 0 : contact;
+            }
+        }
+        else {
+            for (uint64_t i{ 0 }; i < objects_count; i++) {
+                VerletObject&      obj      = m_objects[m_active[i]];
+                const sf::Vector2f v        = m_constraint_center - obj.position;
+                const float        dist     = sqrt(v.x * v.x + v.y * v.y);
+                const float        max_dist = m_constraint_radius - obj.radius;
+                const bool         outside  = !obj.pinned && dist > max_dist;
+
+                m_boundary_contacts[i] = 0;
+                if (outside) {
+                    const sf::Vector2f n = v / dist;
+                    obj.position = m_constraint_center - n * max_dist;
+                    m_boundary_contacts[i] = (obj.position.y > m_constraint_center.y ? floor_contact : ceiling_contact);
                 }
-                if (obj.position.y > (950 - obj.radius)) {
-                    obj.position.y = 950 - obj.radius;
-                    //obj.position_last.y = obj.position.y + v.y * bounce;
+            }
+        }
 
-                    if (obj.type == OBSIDIAN) {
-                        obj.pinned = true;
-                    }
+        // Contact reactions, only for the objects touching the boundary
+        const float step_dt = getStepDt();
+        for (uint64_t i{ objects_count }; i--;) {
+            const uint8_t contact = m_boundary_contacts[i];
+            if (!contact) {
+                continue;
+            }
 
-                    const float dt = getStepDt();
-                    obj.setVelocity(obj.getVelocity(dt) * obj.frictionCoeff, dt);
+            VerletObject& obj = m_objects[m_active[i]];
+            if ((contact & ceiling_contact) && (obj.type == GAS || obj.type == FIRE_GAS)) {
+                markRemoved(obj);
+                continue;
+            }
 
-                    obj.grounded = true;
+            if (contact & floor_contact) {
+                if (obj.type == OBSIDIAN) {
+                    obj.pinned = true;
                 }
-                if (obj.position.y < (50 + obj.radius)) {
-
-                    if (obj.type == GAS || obj.type == FIRE_GAS) {
-                        m_objects.erase(m_objects.begin() + i--);
-                        continue;
-                    }
 
-                    obj.position.y = 50 + obj.radius;
-                    //obj.position_last.y = obj.position.y + v.y * bounce;
-                }
+                obj.setVelocity(obj.getVelocity(step_dt) * obj.getFriction(), step_dt);
+                obj.grounded = true;
             }
-            
-
-            //std::cout << obj.getVelocity(dt).x << " " << obj.getVelocity(dt).y << std::endl;
         }
+
+        removeMarkedObjects();
     }
 
     void updateObjects(float dt)
     {
-        /*for (auto& obj : m_objects) {
-            if(!obj.pinned)
-                obj.update(dt);
-            passiveBehaviorUpdate(obj);
-        }*/
-
-        for (uint64_t i{ 0 }; i < m_objects.size(); i++) {
-            auto& obj = m_objects[i];
-
+        for (const uint32_t i : m_active) {
+            VerletObject& obj = m_objects[i];
             if (!obj.pinned)
                 obj.update(dt);
-            passiveBehaviorUpdate(obj, i);
         }
     }
 
-    void passiveBehaviorUpdate(VerletObject& obj, uint64_t& i) {
-        const int frameNum = getFrameNum();
-        int randFrame;
-        int chance;
-
-        switch (obj.type){
+    void scheduleTimers(const VerletObject& obj)
+    {
+        const ObjectHandle handle = getHandle(obj);
+        switch (obj.type) {
             case GAS:
-                if (frameNum % 300 == 0) {
-                    obj.lifespan--;
-
-                    if (obj.lifespan == 0) {
-                        m_objects.erase(m_objects.begin() + i--);
-                    }
-                }
+            case FIRE_GAS:
+                m_timers.schedule(getNextLifespanTick(), { handle, TimerEvent::Lifespan });
                 break;
 
-            case FIRE_GAS:
-                if (frameNum % 300 == 0) {
-                    obj.lifespan--;
+            case FIRE:
+                m_timers.schedule(getNextLifespanTick(), { handle, TimerEvent::Lifespan });
+                m_timers.schedule(getNextEmission(), { handle, TimerEvent::Emission });
+                break;
 
-                    if (obj.lifespan == 0) {
-                        m_objects.erase(m_objects.begin() + i--);
-                    }
+            case LAVA:
+                m_timers.schedule(getNextEmission(), { handle, TimerEvent::Emission });
+                break;
 
-                    if (obj.counter > 0) {
-                        obj.counter--;
-                    }
-                }
+            default:
                 break;
+        }
+    }
 
-            case FIRE:
-                randFrame = 60 + (rand() % 61);
-                chance = 1 + rand() % 1000;
+    // Lifespans tick on every frame multiple of lifespan_tick_frames
+    uint64_t getNextLifespanTick() const
+    {
+        uint64_t due = (m_frame_num + lifespan_tick_frames - 1) / lifespan_tick_frames * lifespan_tick_frames;
+        if (due <= m_timers.getCurrentFrame()) {
+            due += lifespan_tick_frames;
+        }
+        return due;
+    }
 
-                if (chance > 950 && frameNum % randFrame == 0) {
-                    int randX = -50 + (1 + rand() % 100);
-                    int randY = -1 * (50 + rand() % 50);
+    int getRandom()
+    {
+        return static_cast<int>(m_rng());
+    }
 
-                    VerletObject& tempObj = addObject(obj.position, FIRE_GAS);
-                    tempObj.setVelocity({ (float)randX, (float)randY }, getStepDt());
-                }
+    uint64_t getNextEmission()
+    {
+        return static_cast<uint64_t>(m_frame_num) + 60 + (getRandom() % 61);
+    }
 
-                if (frameNum % 300 == 0) {
-                    obj.lifespan--;
+    // Only objects with a due lifespan tick or emission attempt are visited
+    void updateTimers()
+    {
+        m_timers.advance(m_frame_num, [this](const ObjectTimer& timer) {
+            VerletObject* obj = getObject(timer.handle);
+            if (!obj || obj->removed) {
+                return;
+            }
 
-                    if (obj.lifespan == 0) {
-                        m_objects.erase(m_objects.begin() + i--);
-                    }
+            if (timer.event == TimerEvent::Lifespan) {
+                updateLifespan(*obj);
+            }
+            else {
+                updateEmission(*obj);
+            }
+        });
 
-                    if (obj.counter > 0) {
-                        obj.counter--;
-                    }
-                }
-                break;
+        removeMarkedObjects();
+    }
 
-            case LAVA:
-                randFrame = 60 + (rand() % 61);
-                chance = 1 + rand() % 1000;
+    void updateLifespan(VerletObject& obj)
+    {
+        for (uint32_t i{ lifespan_tick_units }; i--;) {
+            obj.lifespan--;
 
-                if (chance > 950 && frameNum % randFrame == 0) {
-                    int randX = -150 + (rand() % 301);
-                    int randY = -1 * (50 + rand() % 151);
+            if (obj.lifespan == 0) {
+                markRemoved(obj);
+                return;
+            }
 
-                    VerletObject& tempObj = addObject(obj.position, FIRE);
-                    tempObj.setVelocity({ (float)randX, (float)randY }, getStepDt());
-                    tempObj.lifespan = 2;
-                }
-                break;
+            if (obj.type != GAS && obj.counter > 0) {
+                obj.counter--;
+            }
+        }
 
-            case SPAWNER:
-                /*if (obj.spawnerType == NONE) {
-                    applyPushForce(obj.position, obj.bounce);
-                    break;
-                }
+        // Once both are spent nothing observes them anymore
+        if (obj.lifespan > 0 || obj.counter > 0) {
+            m_timers.schedule(m_frame_num + lifespan_tick_frames, { getHandle(obj), TimerEvent::Lifespan });
+        }
+    }
 
-                if (obj.spawnerType == BLACKHOLE) {
-                    applyCentripetalForce(obj.position, obj.bounce, obj.counter);
-                    break;
-                }
+    void updateEmission(VerletObject& obj)
+    {
+        const ObjectHandle handle = getHandle(obj);
+        const sf::Vector2f position = obj.position;
+        const TYPE type = obj.type;
+
+        // 5% chance per roll, at random 60-120 frame intervals
+        for (uint32_t i{ emission_rolls }; i--;) {
+            const int chance = 1 + getRandom() % 1000;
+            if (chance <= 950) {
+                continue;
+            }
 
-                if (frameNum % obj.counter == 0) {
-                    VerletObject& tempObj = addObject(obj.position, obj.spawnerType);
-                    int randNum = rand() % 2;
-                    float offset = (randNum == 0 ? -0.1f : 0.1f);
-                    tempObj.position.x += offset;
-                }*/
-                break;
+            if (type == FIRE) {
+                int randX = -50 + (1 + getRandom() % 100);
+                int randY = -1 * (50 + getRandom() % 50);
+
+                VerletObject& tempObj = addObject(position, FIRE_GAS);
+                tempObj.setVelocity({ (float)randX, (float)randY }, getStepDt());
+            }
+            else {
+                int randX = -150 + (getRandom() % 301);
+                int randY = -1 * (50 + getRandom() % 151);
+
+                VerletObject& tempObj = addObject(position, FIRE);
+                tempObj.setVelocity({ (float)randX, (float)randY }, getStepDt());
+                tempObj.lifespan = 2;
+            }
         }
+
+        m_timers.schedule(getNextEmission(), { handle, TimerEvent::Emission });
     }
 
     void updateSpawner() {
         const int frameNum = getFrameNum();
 
-        for (VerletObject& obj : m_objects) {
-            if (obj.type != SPAWNER) {
-                continue;
+        // Force fields first, they all share the same grid build
+        for (const Spawner& spawner : m_spawners) {
+            if (spawner.spawnerType == NONE) {
+                applyPushForce(spawner.position, spawner.radius);
             }
-
-            if (obj.spawnerType == NONE) {
-                applyPushForce(obj.position, obj.bounce);
-                continue;
+            else if (spawner.spawnerType == BLACKHOLE) {
+                applyCentripetalForce(spawner.position, spawner.radius, spawner.power);
             }
+        }
 
-            if (obj.spawnerType == BLACKHOLE) {
-                applyCentripetalForce(obj.position, obj.bounce, obj.frictionCoeff);
+        for (const Spawner& spawner : m_spawners) {
+            if (spawner.spawnerType == NONE || spawner.spawnerType == BLACKHOLE) {
                 continue;
             }
 
-            if (frameNum % obj.counter == 0) {
-                VerletObject& tempObj = addObject(obj.position, obj.spawnerType);
-                int randNum = rand() % 2;
+            if (spawner.delay > 0 && frameNum % spawner.delay == 0) {
+                VerletObject& tempObj = addObject(spawner.position, spawner.spawnerType);
+                int randNum = getRandom() % 2;
                 float offset = (randNum == 0 ? -0.1f : 0.1f);
                 tempObj.position.x += offset;
             }
         }
     }
 
-    bool computeReaction(VerletObject& object_1, VerletObject& object_2, float mass_ratio_1, float mass_ratio_2, uint64_t& i, uint64_t& k) {
-        if (object_1.type == GAS && object_2.type == OBSIDIAN || object_1.type == OBSIDIAN && object_2.type == GAS) {
-            return false;
-        }
-        if (object_1.type == GAS && object_2.type == FIRE || object_1.type == FIRE && object_2.type == GAS) {
-            return false;
-        }
-        if (object_1.type == FIRE_GAS && object_2.type == FIRE || object_1.type == FIRE && object_2.type == FIRE_GAS) {
-            return false;
-        }
-        if (object_1.type == FIRE_GAS && object_2.type == GAS || object_1.type == GAS && object_2.type == FIRE_GAS) {
-            return false;
-        }
-        if (object_1.type == FIRE_GAS && object_2.type == FIRE_GAS) {
-            return false;
-        }
-        if (object_1.type == FIRE && object_2.type == LAVA || object_1.type == LAVA && object_2.type == FIRE) {
+    bool computeReaction(VerletObject& object_1, VerletObject& object_2, float mass_ratio_1, float mass_ratio_2) {
+        switch (reactions.pairs[object_1.type][object_2.type])
+        {
+        case Reaction::Ignore:
             return false;
-        }
-        
-        if (object_1.type == WATER && object_2.type == LAVA || object_1.type == LAVA && object_2.type == WATER) {
+        case Reaction::Obsidian: {
             float midX = (object_1.position.x + object_2.position.x) / 2.0f;
             float midY = (object_1.position.y + object_2.position.y) / 2.0f;
 
+            // Flagged before spawning, adding objects invalidates both references
+            markRemoved(object_1);
+            markRemoved(object_2);
+
             generateGas(midX, midY);
             addObject({ midX, midY }, OBSIDIAN);
 
-            m_objects.erase(m_objects.begin() + k--);
-            m_objects.erase(m_objects.begin() + i--);
-
             return false;
         }
-
-        if (object_1.type == WATER && object_2.type == FIRE || object_1.type == FIRE && object_2.type == WATER) {
+        case Reaction::Steam: {
             float midX = (object_1.position.x + object_2.position.x) / 2.0f;
             float midY = (object_1.position.y + object_2.position.y) / 2.0f;
 
-            generateGas(midX, midY);
+            markRemoved(object_1);
+            markRemoved(object_2);
 
-            m_objects.erase(m_objects.begin() + k--);
-            m_objects.erase(m_objects.begin() + i--);
+            generateGas(midX, midY);
 
             return false;
         }
-
-        if (object_1.type == GAS && object_2.type == WATER || object_1.type == WATER && object_2.type == GAS) {
+        case Reaction::Bubble:
             if (object_1.type == GAS) {
                 object_1.setVelocity({ 0.0f, -200.0f }, getStepDt());
             }
@@ -975,50 +2256,59 @@ private:
             if (object_2.type == GAS) {
                 object_2.setVelocity({ 0.0f, -200.0f }, getStepDt());
             }
-        }
-
-        if (object_1.type == WOOD && object_2.type == FIRE || object_1.type == FIRE && object_2.type == WOOD) {
-            int randInt = 1 + rand() % 1000;
+            break;
+        case Reaction::Ignite: {
+            int randInt = 1 + getRandom() % 1000;
             if (randInt > 900 && (object_1.counter == 0 || object_2.counter == 0)) {
                 sf::Vector2f pos1 = object_1.position;
                 sf::Vector2f pos2 = object_2.position;
-                if (object_1.type == WOOD) {
+                const bool wood_1 = object_1.type == WOOD;
+                const bool wood_2 = object_2.type == WOOD;
+                markRemoved(object_1);
+                markRemoved(object_2);
+
+                if (wood_1) {
                     generateFire(pos1);
                     generateDarkGas(pos1.x, pos1.y);
                 }
 
-                if (object_2.type == WOOD) {
+                if (wood_2) {
                     generateFire(pos2);
                     generateDarkGas(pos2.x, pos2.y);
                 }
 
-                m_objects.erase(m_objects.begin() + k--);
-                m_objects.erase(m_objects.begin() + i--);
-
                 return false;
             }
+            break;
         }
-
-        if (object_1.type == WOOD && object_2.type == FIRE_GAS || object_1.type == FIRE_GAS && object_2.type == WOOD) {
-            int randInt = 1 + rand() % 1000;
+        case Reaction::IgniteFromGas: {
+            int randInt = 1 + getRandom() % 1000;
             if (randInt > 980 && (object_1.counter == 0 || object_2.counter == 0)) {
                 sf::Vector2f pos1 = object_1.position;
                 sf::Vector2f pos2 = object_2.position;
-                if (object_1.type == WOOD) {
+                const float gas_offset_1 = object_1.radius * 2.0f;
+                const float gas_offset_2 = object_2.radius * 2.0f;
+                const bool wood_1 = object_1.type == WOOD;
+                const bool wood_2 = object_2.type == WOOD;
+                markRemoved(object_1);
+                markRemoved(object_2);
+
+                if (wood_1) {
                     generateFire(pos1);
-                    generateDarkGas(pos1.x, pos1.y - object_1.radius * 2.0f);
+                    generateDarkGas(pos1.x, pos1.y - gas_offset_1);
                 }
 
-                if (object_2.type == WOOD) {
+                if (wood_2) {
                     generateFire(pos2);
-                    generateDarkGas(pos2.x, pos2.y - object_2.radius * 2.0f);
+                    generateDarkGas(pos2.x, pos2.y - gas_offset_2);
                 }
 
-                m_objects.erase(m_objects.begin() + k--);
-                m_objects.erase(m_objects.begin() + i--);
-
                 return false;
             }
+            break;
+        }
+        default:
+            break;
         }
 
         if (object_1.type == OBSIDIAN && object_2.type == OBSIDIAN) {
@@ -1042,30 +2332,32 @@ private:
             }
         }
 
-        if (object_1.frictionCoeff < 0.9f || object_2.frictionCoeff < 0.9f) {
+        const float friction_1 = object_1.getFriction();
+        const float friction_2 = object_2.getFriction();
+        if (friction_1 < 0.9f || friction_2 < 0.9f) {
             const float dt = getStepDt();
-            if (object_1.frictionCoeff < 0.9f) {
+            if (friction_1 < 0.9f) {
                 sf::Vector2f currVel = object_1.getVelocity(dt);
-                object_1.setVelocity({ currVel.x * object_1.frictionCoeff, currVel.y }, dt);
+                object_1.setVelocity({ currVel.x * friction_1, currVel.y }, dt);
             }
-            else if (object_2.frictionCoeff < 0.9f) {
+            else if (friction_2 < 0.9f) {
                 sf::Vector2f currVel = object_2.getVelocity(dt);
-                object_2.setVelocity({ currVel.x * object_2.frictionCoeff, currVel.y }, dt);
+                object_2.setVelocity({ currVel.x * friction_2, currVel.y }, dt);
             }
 
-            if (object_1.frictionCoeff < 0.9f && object_2.pinned) {
+            if (friction_1 < 0.9f && object_2.pinned) {
                 sf::Vector2f currVel = object_1.getVelocity(dt);
-                object_1.setVelocity(currVel * object_1.frictionCoeff, dt);
+                object_1.setVelocity(currVel * friction_1, dt);
             }
-            else if (object_2.frictionCoeff < 0.9f && object_1.pinned) {
+            else if (friction_2 < 0.9f && object_1.pinned) {
                 sf::Vector2f currVel = object_2.getVelocity(dt);
-                object_2.setVelocity(currVel * object_2.frictionCoeff, dt);
+                object_2.setVelocity(currVel * friction_2, dt);
             }
         }
 
         float massDiff = abs(object_1.mass - object_2.mass);
         const float dt = getStepDt();
-        int randInt = rand() % 2;
+        int randInt = getRandom() % 2;
         float velX = (randInt == 0 ? 1.0f : -1.0f) * massDiff * 300.0f;
         float velY = abs(velX) * -0.5;
         if (object_1.isFluid || object_2.isFluid) {
@@ -1100,7 +2392,7 @@ private:
         for (float x = -0.5f; x <= 0.5f; x += 0.5f) {
             for (float y = -0.5f; y <= 0.5f; y += 0.5f) {
                 VerletObject& obj = addObject({ midX + x, midY + y }, GAS);
-                obj.color = { 150,150,150 };
+                obj.color = DARK_GAS_COLOR;
             }
         }
     }
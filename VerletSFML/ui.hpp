@@ -0,0 +1,232 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "button.hpp"
+
+
+// Fonts are loaded once per file and shared, SFML keeps the rendered glyphs in the font textures
+class FontCache
+{
+public:
+    static const sf::Font& get(const std::string& fileName)
+    {
+        static std::map<std::string, std::unique_ptr<sf::Font>> fonts;
+        std::unique_ptr<sf::Font>& font = fonts[fileName];
+        if (!font) {
+            font = std::make_unique<sf::Font>();
+            font->loadFromFile(fileName);
+        }
+        return *font;
+    }
+};
+
+
+// Retained HUD: labels and buttons are turned into vertices only when one of them changes,
+// then drawn as one batch of rectangles and one batch of glyphs per character size.
+class UiLayer
+{
+public:
+    explicit
+    UiLayer(const sf::Font& font_)
+        : m_font{ font_ }
+    {}
+
+    // Returns the id to update the label with
+    uint32_t addLabel(sf::Vector2f position, uint32_t character_size, sf::Color color)
+    {
+        m_labels.push_back({ position, character_size, color });
+        m_dirty = true;
+        return static_cast<uint32_t>(m_labels.size() - 1);
+    }
+
+    // Only rebuilds the geometry if the text differs from the current one
+    void setText(uint32_t label, const std::string& text)
+    {
+        if (m_labels[label].text != text) {
+            m_labels[label].text = text;
+            m_dirty = true;
+        }
+    }
+
+    void setColor(uint32_t label, sf::Color color)
+    {
+        if (m_labels[label].color != color) {
+            m_labels[label].color = color;
+            m_dirty = true;
+        }
+    }
+
+    void setVisible(uint32_t label, bool visible)
+    {
+        if (m_labels[label].visible != visible) {
+            m_labels[label].visible = visible;
+            m_dirty = true;
+        }
+    }
+
+    // The button is drawn from its current state, it has to outlive the layer
+    void addButton(const Button& button)
+    {
+        m_buttons.push_back({ &button, button.getVersion() });
+        m_dirty = true;
+    }
+
+    void draw(sf::RenderTarget& target)
+    {
+        for (ButtonSlot& slot : m_buttons) {
+            if (slot.button->getVersion() != slot.version) {
+                slot.version = slot.button->getVersion();
+                m_dirty      = true;
+            }
+        }
+        if (m_dirty) {
+            rebuild();
+        }
+
+        target.draw(m_rects.data(), m_rects.size(), sf::Triangles);
+        for (const auto& [character_size, glyphs] : m_glyphs) {
+            sf::RenderStates states;
+            states.texture = &m_font.getTexture(character_size);
+            target.draw(glyphs.data(), glyphs.size(), sf::Triangles, states);
+        }
+    }
+
+private:
+    struct Label
+    {
+        sf::Vector2f position;
+        uint32_t     character_size;
+        sf::Color    color;
+        std::string  text;
+        bool         visible = true;
+    };
+
+    struct ButtonSlot
+    {
+        const Button* button;
+        uint32_t      version;
+    };
+
+    const sf::Font&                                 m_font;
+    std::vector<Label>                              m_labels;
+    std::vector<ButtonSlot>                         m_buttons;
+    bool                                            m_dirty = true;
+
+    std::vector<sf::Vertex>                         m_rects;
+    std::map<uint32_t, std::vector<sf::Vertex>>     m_glyphs;
+
+    void rebuild()
+    {
+        m_dirty = false;
+        m_rects.clear();
+        for (auto& [character_size, glyphs] : m_glyphs) {
+            glyphs.clear();
+        }
+
+        for (const Label& label : m_labels) {
+            if (label.visible) {
+                std::vector<sf::Vertex>& glyphs = m_glyphs[label.character_size];
+                const uint64_t first = glyphs.size();
+                appendText(glyphs, label.text, label.character_size, label.color);
+                offset(glyphs, first, label.position);
+            }
+        }
+
+        for (const ButtonSlot& slot : m_buttons) {
+            const Button&      button = *slot.button;
+            const sf::Vector2f size   = button.getSize();
+            const sf::Vector2f corner = button.getPosition() - 0.5f * size;
+            appendQuad(m_rects, { corner, size }, {}, button.getColor());
+
+            std::vector<sf::Vertex>& glyphs = m_glyphs[button.getFontSize()];
+            const uint64_t      first  = glyphs.size();
+            const sf::FloatRect bounds = appendText(glyphs, button.getText(), button.getFontSize(), sf::Color::Blue);
+            // Same placement the buttons always had
+            offset(glyphs, first, button.getPosition() + sf::Vector2f{ size.x / 2.0f - bounds.width, size.y / 3.0f - 3.0f * bounds.height });
+        }
+    }
+
+    static void appendQuad(std::vector<sf::Vertex>& vertices, sf::FloatRect rect, sf::FloatRect texture_rect, sf::Color color)
+    {
+        const sf::Vertex top_left     = { { rect.left, rect.top }, color, { texture_rect.left, texture_rect.top } };
+        const sf::Vertex top_right    = { { rect.left + rect.width, rect.top }, color, { texture_rect.left + texture_rect.width, texture_rect.top } };
+        const sf::Vertex bottom_left  = { { rect.left, rect.top + rect.height }, color, { texture_rect.left, texture_rect.top + texture_rect.height } };
+        const sf::Vertex bottom_right = { { rect.left + rect.width, rect.top + rect.height }, color,
+                                          { texture_rect.left + texture_rect.width, texture_rect.top + texture_rect.height } };
+        vertices.insert(vertices.end(), { top_left, top_right, bottom_left, bottom_left, top_right, bottom_right });
+    }
+
+    static void offset(std::vector<sf::Vertex>& vertices, uint64_t first, sf::Vector2f delta)
+    {
+        for (uint64_t i{ first }; i < vertices.size(); i++) {
+            vertices[i].position += delta;
+        }
+    }
+
+    // Lays the glyphs out like sf::Text with the origin at the top left, returns the same local bounds
+    sf::FloatRect appendText(std::vector<sf::Vertex>& vertices, const std::string& text, uint32_t character_size, sf::Color color) const
+    {
+        const float whitespace_width = m_font.getGlyph(L' ', character_size, false).advance;
+        const float line_spacing     = m_font.getLineSpacing(character_size);
+        // Glyphs are padded in the texture so their edges are not cut by smoothing
+        const float padding          = 1.0f;
+
+        float    x        = 0.0f;
+        float    y        = static_cast<float>(character_size);
+        float    min_x    = static_cast<float>(character_size);
+        float    min_y    = static_cast<float>(character_size);
+        float    max_x    = 0.0f;
+        float    max_y    = 0.0f;
+        uint32_t previous = 0;
+        for (const char c : text) {
+            const uint32_t current = static_cast<uint8_t>(c);
+            // Carriage returns are skipped, as in sf::Text
+            if (current == '\r') {
+                continue;
+            }
+            x += m_font.getKerning(previous, current, character_size, false);
+            previous = current;
+
+            if (current == ' ' || current == '\n' || current == '\t') {
+                min_x = std::min(min_x, x);
+                min_y = std::min(min_y, y);
+                if (current == ' ') {
+                    x += whitespace_width;
+                }
+                else if (current == '\t') {
+                    x += whitespace_width * 4.0f;
+                }
+                else {
+                    y += line_spacing;
+                    x  = 0.0f;
+                }
+                max_x = std::max(max_x, x);
+                max_y = std::max(max_y, y);
+                continue;
+            }
+
+            const sf::Glyph&    glyph   = m_font.getGlyph(current, character_size, false);
+            const sf::FloatRect bounds  = glyph.bounds;
+            const sf::IntRect&  texture = glyph.textureRect;
+            appendQuad(vertices,
+                       { x + bounds.left - padding, y + bounds.top - padding, bounds.width + 2.0f * padding, bounds.height + 2.0f * padding },
+                       { texture.left - padding, texture.top - padding, texture.width + 2.0f * padding, texture.height + 2.0f * padding },
+                       color);
+
+            min_x = std::min(min_x, x + bounds.left);
+            max_x = std::max(max_x, x + bounds.left + bounds.width);
+            min_y = std::min(min_y, y + bounds.top);
+            max_y = std::max(max_y, y + bounds.top + bounds.height);
+            x += glyph.advance;
+        }
+
+        if (text.empty()) {
+            return {};
+        }
+        return { min_x, min_y, max_x - min_x, max_y - min_y };
+    }
+};
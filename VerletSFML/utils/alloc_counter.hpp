@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+
+// Counts the heap allocations of the whole program.
+// The counters only move in executables where one source file includes alloc_counter_hook.hpp,
+// which replaces the global operator new and delete. They stay at 0 otherwise.
+struct AllocCounter
+{
+    struct Snapshot
+    {
+        uint64_t allocations     = 0;
+        uint64_t frees           = 0;
+        uint64_t allocated_bytes = 0;
+    };
+
+    static std::atomic<uint64_t>& allocations()
+    {
+        static std::atomic<uint64_t> count = 0;
+        return count;
+    }
+
+    static std::atomic<uint64_t>& frees()
+    {
+        static std::atomic<uint64_t> count = 0;
+        return count;
+    }
+
+    static std::atomic<uint64_t>& allocatedBytes()
+    {
+        static std::atomic<uint64_t> count = 0;
+        return count;
+    }
+
+    [[nodiscard]]
+    static Snapshot get()
+    {
+        return { allocations().load(std::memory_order_relaxed), frees().load(std::memory_order_relaxed),
+                 allocatedBytes().load(std::memory_order_relaxed) };
+    }
+
+    // What happened between two snapshots
+    [[nodiscard]]
+    static Snapshot since(const Snapshot& start)
+    {
+        const Snapshot now = get();
+        return { now.allocations - start.allocations, now.frees - start.frees, now.allocated_bytes - start.allocated_bytes };
+    }
+
+    static void onAllocation(std::size_t size)
+    {
+        allocations().fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes().fetch_add(size, std::memory_order_relaxed);
+    }
+
+    static void onFree()
+    {
+        frees().fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdlib>
+#include <new>
+
+#include "alloc_counter.hpp"
+
+
+// Replaces the global allocation functions to feed AllocCounter.
+// Include it from exactly one source file of an executable, they would be defined twice otherwise.
+// The nothrow forms forward to these by default, the aligned ones are left alone.
+void* operator new(std::size_t size)
+{
+    AllocCounter::onAllocation(size);
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer) {
+        AllocCounter::onFree();
+        std::free(pointer);
+    }
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
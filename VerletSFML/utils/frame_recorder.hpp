@@ -0,0 +1,233 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
+
+#include "trace.hpp"
+
+
+// Writes the rendered frames to an image sequence.
+// The pixels are read straight into a ring of preallocated slots and encoded by worker threads.
+// When every slot is still waiting for a worker the frame is dropped, the render loop never waits.
+class FrameRecorder
+{
+public:
+    enum class Format
+    {
+        // One PNG per frame
+        Png,
+        // Uncompressed RGBA rows, top to bottom, the size is in the file name
+        Raw
+    };
+
+    FrameRecorder() = default;
+
+    ~FrameRecorder()
+    {
+        stop();
+    }
+
+    bool start(const std::string& directory, uint32_t width, uint32_t height, Format format = Format::Png)
+    {
+        stop();
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (error) {
+            return false;
+        }
+
+        m_directory = directory;
+        m_width     = width;
+        m_height    = height;
+        m_format    = format;
+        m_frame     = 0;
+        m_written   = 0;
+        m_dropped   = 0;
+
+        // Allocated once per recording, capture() only copies into them
+        m_slots.resize(slots_count);
+        m_free_slots.clear();
+        for (uint32_t i{ 0 }; i < slots_count; i++) {
+            m_slots[i].pixels.resize(static_cast<uint64_t>(width) * height * 4);
+            m_free_slots.push_back(i);
+        }
+        m_pending.clear();
+
+        m_running = true;
+        const uint32_t workers_count = std::max(1u, std::min(max_workers_count, std::thread::hardware_concurrency() / 2));
+        for (uint32_t i{ 0 }; i < workers_count; i++) {
+            m_workers.emplace_back([this] { workerLoop(); });
+        }
+        return true;
+    }
+
+    // Waits for the frames already captured to be written
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                return;
+            }
+            m_running = false;
+        }
+        m_condition.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+        m_workers.clear();
+    }
+
+    // Call after drawing and before display(), the back buffer is read.
+    // Returns false if the frame was dropped.
+    bool capture(sf::RenderWindow& window)
+    {
+        if (!isRecording()) {
+            return false;
+        }
+
+        const uint64_t frame = m_frame++;
+        uint32_t slot_index;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_free_slots.empty()) {
+                m_dropped++;
+                return false;
+            }
+            slot_index = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+
+        // The window may have been resized since start(), read what still fits
+        TraceScope trace{ "Read pixels" };
+        Slot& slot = m_slots[slot_index];
+        const sf::Vector2u size = window.getSize();
+        slot.frame  = frame;
+        slot.width  = std::min(m_width, size.x);
+        slot.height = std::min(m_height, size.y);
+        if (window.setActive(true)) {
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            // Rows come bottom-up, the workers flip them
+            glReadPixels(0, static_cast<GLint>(size.y - slot.height), slot.width, slot.height, GL_RGBA, GL_UNSIGNED_BYTE, slot.pixels.data());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(slot_index);
+        }
+        m_condition.notify_one();
+        return true;
+    }
+
+    [[nodiscard]]
+    bool isRecording() const
+    {
+        return !m_workers.empty();
+    }
+
+    [[nodiscard]]
+    uint64_t getCapturedCount() const
+    {
+        return m_frame - getDroppedCount();
+    }
+
+    [[nodiscard]]
+    uint64_t getWrittenCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_written;
+    }
+
+    [[nodiscard]]
+    uint64_t getDroppedCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+private:
+    static constexpr uint32_t slots_count       = 8;
+    static constexpr uint32_t max_workers_count = 4;
+
+    struct Slot
+    {
+        std::vector<uint8_t> pixels;
+        uint64_t             frame  = 0;
+        uint32_t             width  = 0;
+        uint32_t             height = 0;
+    };
+
+    std::string               m_directory;
+    uint32_t                  m_width   = 0;
+    uint32_t                  m_height  = 0;
+    Format                    m_format  = Format::Png;
+    uint64_t                  m_frame   = 0;
+    uint64_t                  m_written = 0;
+    uint64_t                  m_dropped = 0;
+
+    std::vector<Slot>         m_slots;
+    std::vector<uint32_t>     m_free_slots;
+    std::deque<uint32_t>      m_pending;
+    std::vector<std::thread>  m_workers;
+    bool                      m_running = false;
+    mutable std::mutex        m_mutex;
+    std::condition_variable   m_condition;
+
+    void workerLoop()
+    {
+        Tracer::get().setThreadName("Frame encoder");
+        sf::Image image;
+        for (;;) {
+            uint32_t slot_index;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return !m_pending.empty() || !m_running; });
+                // Pending frames are still written after stop()
+                if (m_pending.empty()) {
+                    return;
+                }
+                slot_index = m_pending.front();
+                m_pending.pop_front();
+            }
+
+            Slot& slot = m_slots[slot_index];
+            TraceScope trace{ "Encode frame" };
+            const bool written = writeSlot(slot, image);
+            trace.end();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_written += written;
+            m_free_slots.push_back(slot_index);
+        }
+    }
+
+    bool writeSlot(Slot& slot, sf::Image& image) const
+    {
+        char name[64];
+        if (m_format == Format::Png) {
+            std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(slot.frame));
+            image.create(slot.width, slot.height, slot.pixels.data());
+            image.flipVertically();
+            return image.saveToFile(m_directory + "/" + name);
+        }
+
+        std::snprintf(name, sizeof(name), "frame_%06llu_%ux%u.rgba", static_cast<unsigned long long>(slot.frame), slot.width, slot.height);
+        std::ofstream file(m_directory + "/" + name, std::ios::binary);
+        const uint64_t row_size = static_cast<uint64_t>(slot.width) * 4;
+        for (uint32_t y{ slot.height }; y--;) {
+            file.write(reinterpret_cast<const char*>(slot.pixels.data() + y * row_size), row_size);
+        }
+        return static_cast<bool>(file);
+    }
+};
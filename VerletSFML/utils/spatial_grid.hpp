@@ -0,0 +1,144 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <SFML/System/Vector2.hpp>
+
+
+// Uniform grid over object positions.
+// Built with a counting sort so every cell is a contiguous range of object indices.
+class SpatialGrid
+{
+public:
+    SpatialGrid() = default;
+
+    template<typename TObjectContainer>
+    void build(const TObjectContainer& objects, float cell_size)
+    {
+        buildFrom(objects.size(), [&](uint64_t i) { return objects[i].position; }, cell_size);
+    }
+
+    // Only the listed objects, queries then return positions in `indices` instead of object indices
+    template<typename TObjectContainer, typename TIndexContainer>
+    void build(const TObjectContainer& objects, const TIndexContainer& indices, float cell_size)
+    {
+        buildFrom(indices.size(), [&](uint64_t i) { return objects[indices[i]].position; }, cell_size);
+    }
+
+    // Calls callback(index) for every object in the cells overlapping the query square.
+    // Callers still have to test the exact distance.
+    template<typename TCallback>
+    void query(sf::Vector2f center, float radius, TCallback&& callback) const
+    {
+        if (m_indices.empty()) {
+            return;
+        }
+
+        const int32_t min_x = getCellCoord(center.x - radius - m_origin.x, m_width);
+        const int32_t max_x = getCellCoord(center.x + radius - m_origin.x, m_width);
+        const int32_t min_y = getCellCoord(center.y - radius - m_origin.y, m_height);
+        const int32_t max_y = getCellCoord(center.y + radius - m_origin.y, m_height);
+
+        for (int32_t y{ min_y }; y <= max_y; y++) {
+            for (int32_t x{ min_x }; x <= max_x; x++) {
+                const uint64_t cell = static_cast<uint64_t>(y) * m_width + x;
+                for (uint32_t k{ m_cell_start[cell] }; k < m_cell_start[cell + 1]; k++) {
+                    callback(m_indices[k]);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]]
+    uint64_t getMemoryBytes() const
+    {
+        return (m_cell_start.capacity() + m_cell_fill.capacity() + m_object_cell.capacity() + m_indices.capacity()) * sizeof(uint32_t);
+    }
+
+    void clear()
+    {
+        m_cell_start.clear();
+        m_indices.clear();
+        m_object_cell.clear();
+    }
+
+private:
+    static constexpr float max_cells_count = 4'000'000.0f;
+
+    float                 m_cell_size = 32.0f;
+    sf::Vector2f          m_origin;
+    int32_t               m_width     = 0;
+    int32_t               m_height    = 0;
+
+    std::vector<uint32_t> m_cell_start;
+    std::vector<uint32_t> m_cell_fill;
+    std::vector<uint32_t> m_object_cell;
+    std::vector<uint32_t> m_indices;
+
+    template<typename TPositionGetter>
+    void buildFrom(uint64_t objects_count, TPositionGetter&& get_position, float cell_size)
+    {
+        m_cell_size = cell_size;
+
+        // Fit the grid on the objects instead of the world so it never has to be resized
+        sf::Vector2f min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        sf::Vector2f max = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+        for (uint64_t i{ 0 }; i < objects_count; i++) {
+            const sf::Vector2f position = get_position(i);
+            if (!std::isfinite(position.x) || !std::isfinite(position.y)) {
+                continue;
+            }
+            min.x = std::min(min.x, position.x);
+            min.y = std::min(min.y, position.y);
+            max.x = std::max(max.x, position.x);
+            max.y = std::max(max.y, position.y);
+        }
+        if (min.x > max.x || min.y > max.y) {
+            min = max = {};
+        }
+
+        // Keep the cell count bounded if objects are scattered very far apart
+        while ((max.x - min.x) / m_cell_size * (max.y - min.y) / m_cell_size > max_cells_count) {
+            m_cell_size *= 2.0f;
+        }
+
+        m_origin = min;
+        m_width  = static_cast<int32_t>((max.x - min.x) / m_cell_size) + 1;
+        m_height = static_cast<int32_t>((max.y - min.y) / m_cell_size) + 1;
+
+        const uint64_t cells_count = static_cast<uint64_t>(m_width) * m_height;
+        m_cell_start.assign(cells_count + 1, 0);
+        m_object_cell.resize(objects_count);
+        m_indices.resize(objects_count);
+
+        for (uint64_t i{ 0 }; i < objects_count; i++) {
+            const uint32_t cell = getCellIndex(get_position(i));
+            m_object_cell[i] = cell;
+            m_cell_start[cell + 1]++;
+        }
+        for (uint64_t c{ 0 }; c < cells_count; c++) {
+            m_cell_start[c + 1] += m_cell_start[c];
+        }
+
+        m_cell_fill.assign(m_cell_start.begin(), m_cell_start.end() - 1);
+        for (uint64_t i{ 0 }; i < objects_count; i++) {
+            m_indices[m_cell_fill[m_object_cell[i]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    int32_t getCellCoord(float offset, int32_t size) const
+    {
+        // Written so that NaN or infinite positions end up in a border cell
+        const float coord = std::max(0.0f, offset / m_cell_size);
+        return static_cast<int32_t>(std::min(coord, static_cast<float>(size - 1)));
+    }
+
+    uint32_t getCellIndex(sf::Vector2f position) const
+    {
+        const int32_t x = getCellCoord(position.x - m_origin.x, m_width);
+        const int32_t y = getCellCoord(position.y - m_origin.y, m_height);
+        return static_cast<uint32_t>(y * m_width + x);
+    }
+};
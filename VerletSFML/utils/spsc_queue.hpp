@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+// Fixed capacity single-producer / single-consumer ring buffer.
+// push() may only be called from one thread and pop() from one other thread.
+template<typename T, uint32_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+
+    // Returns false if the queue is full, the value is then dropped
+    bool push(const T& value)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        const uint32_t tail = m_tail.load(std::memory_order_acquire);
+        if (head - tail == Capacity) {
+            return false;
+        }
+
+        m_buffer[head & mask] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint32_t head = m_head.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+
+        value = m_buffer[tail & mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr uint32_t mask = Capacity - 1;
+
+    std::array<T, Capacity>           m_buffer;
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<uint32_t> m_head = 0;
+    alignas(64) std::atomic<uint32_t> m_tail = 0;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+
+// Hashed timing wheel keyed on frame number.
+// Events further away than the wheel size stay in their bucket and are skipped until their round comes.
+template<typename T>
+class TimerWheel
+{
+public:
+    explicit
+    TimerWheel(uint32_t slots_count = 512)
+    {
+        uint32_t size = 1;
+        while (size < slots_count) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    void schedule(uint64_t due_frame, const T& payload)
+    {
+        // Never schedule in the past, it would wait for a full turn of the wheel
+        if (due_frame <= m_current_frame) {
+            due_frame = m_current_frame + 1;
+        }
+        m_slots[due_frame & m_mask].push_back({due_frame, payload});
+        m_size++;
+    }
+
+    // Fire every event due up to and including `frame`
+    template<typename TCallback>
+    void advance(uint64_t frame, TCallback&& callback)
+    {
+        if (frame <= m_current_frame) {
+            return;
+        }
+
+        // After a long pause every bucket only needs to be visited once
+        const uint64_t steps = std::min<uint64_t>(frame - m_current_frame, m_slots.size());
+        const uint64_t first = frame - steps + 1;
+        m_current_frame = frame;
+
+        for (uint64_t f{first}; f <= frame; f++) {
+            std::vector<Entry>& slot = m_slots[f & m_mask];
+            if (slot.empty()) {
+                continue;
+            }
+
+            // Callbacks may reschedule into this very bucket, so take it out first
+            m_firing.swap(slot);
+            for (const Entry& entry : m_firing) {
+                if (entry.due_frame <= frame) {
+                    m_size--;
+                    callback(entry.payload);
+                }
+                else {
+                    slot.push_back(entry);
+                }
+            }
+            m_firing.clear();
+        }
+    }
+
+    void clear()
+    {
+        for (auto& slot : m_slots) {
+            slot.clear();
+        }
+        m_size = 0;
+    }
+
+    [[nodiscard]]
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    [[nodiscard]]
+    uint64_t getCurrentFrame() const
+    {
+        return m_current_frame;
+    }
+
+    // Slot capacities included
+    [[nodiscard]]
+    uint64_t getMemoryBytes() const
+    {
+        uint64_t bytes = m_slots.capacity() * sizeof(std::vector<Entry>) + m_firing.capacity() * sizeof(Entry);
+        for (const std::vector<Entry>& slot : m_slots) {
+            bytes += slot.capacity() * sizeof(Entry);
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t due_frame;
+        T        payload;
+    };
+
+    std::vector<std::vector<Entry>> m_slots;
+    std::vector<Entry>              m_firing;
+    uint64_t                        m_mask          = 0;
+    uint64_t                        m_current_frame = 0;
+    uint64_t                        m_size          = 0;
+};
@@ -0,0 +1,230 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+
+
+// Records timed scopes from any thread and writes them as Chrome trace JSON,
+// to open in chrome://tracing or ui.perfetto.dev.
+// Every thread appends to its own preallocated buffer, recording takes no lock.
+// Buffers are only allocated for threads recording during a capture, and the buffer of a thread which ended
+// is handed to the next thread needing one, the events it holds stay on the same timeline row.
+class Tracer
+{
+public:
+    static Tracer& get()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // Drops what was recorded before
+    void start()
+    {
+        m_epoch.fetch_add(1, std::memory_order_relaxed);
+        m_enabled.store(true, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        m_enabled.store(false, std::memory_order_release);
+    }
+
+    [[nodiscard]]
+    bool isEnabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+    }
+
+    // `name` has to outlive the trace, string literals are expected
+    void record(const char* name, int64_t start_ns, int64_t end_ns)
+    {
+        ThreadBuffer& buffer = getThreadBuffer();
+        const uint32_t epoch = m_epoch.load(std::memory_order_relaxed);
+        if (buffer.epoch.load(std::memory_order_relaxed) != epoch) {
+            buffer.count.store(0, std::memory_order_relaxed);
+            buffer.dropped.store(0, std::memory_order_relaxed);
+            buffer.epoch.store(epoch, std::memory_order_release);
+        }
+
+        const uint32_t count = buffer.count.load(std::memory_order_relaxed);
+        if (count == events_per_thread) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        buffer.events[count] = { name, start_ns, end_ns - start_ns };
+        // Published after the event is complete so write() never reads a partial one
+        buffer.count.store(count + 1, std::memory_order_release);
+    }
+
+    // Shows in the timeline instead of the thread id, kept until the thread records its first event
+    void setThreadName(const char* name)
+    {
+        ThreadSlot& slot = getThreadSlot();
+        slot.name = name;
+        if (slot.buffer) {
+            slot.buffer->name.store(name, std::memory_order_relaxed);
+        }
+    }
+
+    // Meant to be called once recording is stopped, events still being added are left out
+    bool write(const std::string& fileName)
+    {
+        std::ofstream file(fileName);
+        if (!file) {
+            return false;
+        }
+
+        const uint32_t epoch = m_epoch.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (uint64_t t{ 0 }; t < m_buffers.size(); t++) {
+            const ThreadBuffer& buffer = *m_buffers[t];
+            if (buffer.epoch.load(std::memory_order_acquire) != epoch) {
+                continue;
+            }
+
+            const char* name = buffer.name.load(std::memory_order_relaxed);
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+                 << ",\"args\":{\"name\":\"" << (name ? name : "Thread") << "\"}}";
+            first = false;
+
+            const uint32_t count = buffer.count.load(std::memory_order_acquire);
+            for (uint32_t i{ 0 }; i < count; i++) {
+                const Event& event = buffer.events[i];
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+                     << ",\"ts\":" << event.start_ns / 1000 << "." << event.start_ns % 1000 / 100
+                     << ",\"dur\":" << event.duration_ns / 1000 << "." << event.duration_ns % 1000 / 100 << "}";
+            }
+            const uint64_t dropped = buffer.dropped.load(std::memory_order_relaxed);
+            if (dropped) {
+                file << ",\n{\"name\":\"" << dropped << " events dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << t
+                     << ",\"ts\":" << (count ? buffer.events[count - 1].start_ns / 1000 : 0) << "}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    // About a minute of a busy frame loop on the main thread
+    static constexpr uint32_t events_per_thread = 1 << 18;
+
+    struct Event
+    {
+        const char* name;
+        int64_t     start_ns;
+        int64_t     duration_ns;
+    };
+
+    struct ThreadBuffer
+    {
+        std::vector<Event>       events;
+        // Only written by the owning thread, atomic since write() reads them from another one
+        std::atomic<uint32_t>    count   = 0;
+        std::atomic<uint32_t>    epoch   = 0;
+        std::atomic<uint64_t>    dropped = 0;
+        std::atomic<const char*> name    = nullptr;
+    };
+
+    // Hands the buffer back when its thread ends
+    struct ThreadSlot
+    {
+        ThreadBuffer* buffer = nullptr;
+        const char*   name   = nullptr;
+
+        ~ThreadSlot()
+        {
+            if (buffer) {
+                Tracer::get().release(buffer);
+            }
+        }
+    };
+
+    const std::chrono::steady_clock::time_point m_origin = std::chrono::steady_clock::now();
+    std::atomic<bool>                            m_enabled = false;
+    std::atomic<uint32_t>                        m_epoch   = 0;
+    std::vector<std::unique_ptr<ThreadBuffer>>   m_buffers;
+    // Buffers of the threads which ended
+    std::vector<ThreadBuffer*>                   m_free_buffers;
+    std::mutex                                   m_buffers_mutex;
+
+    Tracer() = default;
+
+    static ThreadSlot& getThreadSlot()
+    {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    ThreadBuffer& getThreadBuffer()
+    {
+        ThreadSlot& slot = getThreadSlot();
+        if (!slot.buffer) {
+            // Only once per thread
+            std::lock_guard<std::mutex> lock(m_buffers_mutex);
+            if (!m_free_buffers.empty()) {
+                // Its count and epoch are kept, record() starts it over on a new capture only
+                slot.buffer = m_free_buffers.back();
+                m_free_buffers.pop_back();
+            }
+            else {
+                slot.buffer = m_buffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+                slot.buffer->events.resize(events_per_thread);
+                slot.buffer->epoch.store(m_epoch.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            }
+            slot.buffer->name.store(slot.name, std::memory_order_relaxed);
+        }
+        return *slot.buffer;
+    }
+
+    void release(ThreadBuffer* buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        m_free_buffers.push_back(buffer);
+    }
+};
+
+
+// Records the time until it is destroyed or end() is called, costs a branch while tracing is off
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name_)
+        : m_name{ Tracer::get().isEnabled() ? name_ : nullptr }
+        , m_start{ m_name ? Tracer::get().now() : 0 }
+    {}
+
+    ~TraceScope()
+    {
+        end();
+    }
+
+    void end()
+    {
+        if (m_name) {
+            Tracer::get().record(m_name, m_start, Tracer::get().now());
+            m_name = nullptr;
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t     m_start;
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "trace.hpp"
+
+
+// Threads started on first use and parked between parallel passes, so a pass does not pay for creating threads.
+// One pass runs at a time, a caller finding the pool busy runs all of its slices itself.
+class WorkerPool
+{
+public:
+    static WorkerPool& get()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    // Workers and the calling thread
+    [[nodiscard]]
+    uint32_t getThreadsCount() const
+    {
+        return static_cast<uint32_t>(m_workers.size()) + 1;
+    }
+
+    // Calls callback(slice) once for every slice in [0, slices_count) and returns when all of them are done
+    template<typename TCallback>
+    void forEachSlice(uint32_t slices_count, TCallback&& callback)
+    {
+        bool idle = false;
+        if (slices_count <= 1 || m_workers.empty() || !m_busy.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+            for (uint32_t slice{ 0 }; slice < slices_count; slice++) {
+                callback(slice);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = [](void* context, uint32_t slice) {
+                (*static_cast<std::remove_reference_t<TCallback>*>(context))(slice);
+            };
+            m_context      = const_cast<void*>(static_cast<const void*>(&callback));
+            m_slices_count = slices_count;
+            m_next_slice.store(0, std::memory_order_relaxed);
+            m_pending      = static_cast<uint32_t>(m_workers.size());
+            m_pass++;
+        }
+        m_wake.notify_all();
+        runSlices();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending == 0; });
+        m_busy.store(false, std::memory_order_release);
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex               m_mutex;
+    std::condition_variable  m_wake;
+    std::condition_variable  m_done;
+    std::atomic<bool>        m_busy         = false;
+    bool                     m_stop         = false;
+    uint64_t                 m_pass         = 0;
+    uint32_t                 m_pending      = 0;
+    // Current pass, only written while no worker runs
+    void                   (*m_task)(void*, uint32_t) = nullptr;
+    void*                    m_context      = nullptr;
+    uint32_t                 m_slices_count = 0;
+    std::atomic<uint32_t>    m_next_slice   = 0;
+
+    WorkerPool()
+    {
+        const uint32_t workers_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        m_workers.reserve(workers_count);
+        for (uint32_t i{ 0 }; i < workers_count; i++) {
+            m_workers.emplace_back([this] { run(); });
+        }
+    }
+
+    void run()
+    {
+        Tracer::get().setThreadName("Worker");
+        uint64_t pass = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stop || m_pass != pass; });
+                if (m_stop) {
+                    return;
+                }
+                pass = m_pass;
+            }
+
+            runSlices();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    // Slices are taken in order by whichever thread is free, uneven slices balance themselves
+    void runSlices()
+    {
+        for (uint32_t slice{ m_next_slice.fetch_add(1, std::memory_order_relaxed) }; slice < m_slices_count;
+             slice = m_next_slice.fetch_add(1, std::memory_order_relaxed)) {
+            TraceScope trace{ "Worker slice" };
+            m_task(m_context, slice);
+        }
+    }
+};